@@ -2,7 +2,10 @@
  * ******************************************************************
  * ZYNTHIAN PROJECT: WiringPi Emulation Library
  * 
- * Emulates WiringPi library using POSIX RT signals
+ * Emulates WiringPi library using a shared-memory virtual GPIO.
+ * Pin levels & an edge FIFO live in a shared-memory region, so an
+ * external driver can inject timestamped edges. ISRs are run from
+ * a normal thread. POSIX RT signals are still accepted as input.
  * 
  * Copyright (C) 2015-2016 Fernando Moyano <jofemodo@zynthian.org>
  *
@@ -24,17 +27,21 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "wiringPiEmu.h"
 
 //-------------------------------------------------------------------
-// GPIO Emulation using RT POSIX signals
+// Shared-memory virtual GPIO
 //-------------------------------------------------------------------
 
-#define GPIO_MAX 15
-
 //GPIO Emulation Data Structure
 struct gpio_pin {
 	int pin;
@@ -42,20 +49,178 @@ struct gpio_pin {
 	int pullUpDnCtr;
 	int isrmode;
 	void (*isrfunc)(void);
-	volatile unsigned int status;
 };
-struct gpio_pin gpio[GPIO_MAX];
+struct gpio_pin gpio[WPIEMU_NUM_PINS];
+
+struct wpiemu_shm_st *wpiemu_shm=NULL;
+pthread_t wpiemu_tid;
+//Only set in the edges thread, while running the ISRs
+__thread uint64_t wpiemu_edge_tsus=0;
+
+struct wpiemu_shm_st *wpiemu_create() {
+	struct wpiemu_shm_st *shm=NULL;
+	int fd=shm_open(WPIEMU_SHM_NAME, O_RDWR | O_CREAT, 0666);
+	if (fd>=0) {
+		if (ftruncate(fd, sizeof(struct wpiemu_shm_st))==0) {
+			shm=mmap(NULL, sizeof(struct wpiemu_shm_st), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (shm==MAP_FAILED) shm=NULL;
+		}
+		close(fd);
+	}
+	if (!shm) {
+		//Not shared, but RT signals keep working
+		printf("ERROR WiringPiEmu: Can't create shared memory %s => %s\n", WPIEMU_SHM_NAME, strerror(errno));
+		shm=calloc(1, sizeof(struct wpiemu_shm_st));
+	}
+	int i;
+	shm->magic=0;
+	for (i=0;i<WPIEMU_NUM_PINS;i++) shm->levels[i]=0;
+	for (i=0;i<WPIEMU_FIFO_SIZE;i++) shm->edges[i].seq=i;
+	shm->head=0;
+	shm->tail=0;
+	shm->dropped=0;
+	shm->dispatched=0;
+	sem_init(&shm->edges_sem, 1, 0);
+	shm->version=WPIEMU_SHM_VERSION;
+	__atomic_store_n(&shm->magic, WPIEMU_SHM_MAGIC, __ATOMIC_RELEASE);
+	return shm;
+}
+
+struct wpiemu_shm_st *wpiemu_attach(void) {
+	int fd=shm_open(WPIEMU_SHM_NAME, O_RDWR, 0);
+	if (fd<0) return NULL;
+	struct wpiemu_shm_st *shm=mmap(NULL, sizeof(struct wpiemu_shm_st), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm==MAP_FAILED) return NULL;
+	if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE)!=WPIEMU_SHM_MAGIC || shm->version!=WPIEMU_SHM_VERSION) {
+		munmap(shm, sizeof(struct wpiemu_shm_st));
+		return NULL;
+	}
+	return shm;
+}
+
+//Lock-free & async-signal-safe => can be called from several producers & signal handlers
+int wpiemu_push_edge(struct wpiemu_shm_st *shm, uint16_t pin, uint16_t value, uint64_t tsus) {
+	uint32_t pos=__atomic_load_n(&shm->head, __ATOMIC_RELAXED);
+	while (1) {
+		struct wpiemu_edge_st *edge=shm->edges + (pos & (WPIEMU_FIFO_SIZE-1));
+		int32_t dif=(int32_t)(__atomic_load_n(&edge->seq, __ATOMIC_ACQUIRE) - pos);
+		if (dif==0) {
+			if (__atomic_compare_exchange_n(&shm->head, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				edge->pin=pin;
+				edge->value=value;
+				edge->tsus=tsus;
+				__atomic_store_n(&edge->seq, pos+1, __ATOMIC_RELEASE);
+				return 1;
+			}
+		} else if (dif<0) {
+			__atomic_add_fetch(&shm->dropped, 1, __ATOMIC_RELAXED);
+			return 0;
+		} else {
+			pos=__atomic_load_n(&shm->head, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void wpiemu_notify(struct wpiemu_shm_st *shm) {
+	sem_post(&shm->edges_sem);
+}
+
+uint64_t wiringPiEmuEdgeTsus(void) {
+	return wpiemu_edge_tsus;
+}
+
+//Dispatch the edges in the FIFO => single consumer
+void wpiemu_dispatch_edges(struct wpiemu_shm_st *shm) {
+	uint32_t pos=shm->tail;
+	while (1) {
+		struct wpiemu_edge_st *edge=shm->edges + (pos & (WPIEMU_FIFO_SIZE-1));
+		if (__atomic_load_n(&edge->seq, __ATOMIC_ACQUIRE)!=pos+1) break;
+		uint16_t pin=edge->pin;
+		uint8_t value=edge->value ? 1 : 0;
+		wpiemu_edge_tsus=edge->tsus;
+		__atomic_store_n(&edge->seq, pos+WPIEMU_FIFO_SIZE, __ATOMIC_RELEASE);
+		pos++;
+		if (pin<WPIEMU_NUM_PINS) {
+			uint8_t last=shm->levels[pin];
+			shm->levels[pin]=value;
+			shm->dispatched++;
+			//printf("INFO WiringPiEmu: Received GPIO %d => %d\n",pin,value);
+			if (pin>=64 && value!=last) {
+				struct wiringPiNodeStruct *node=wiringPiFindNode(pin);
+				if (node && node->pinChanged) node->pinChanged(node, pin, value, wpiemu_edge_tsus);
+			}
+			void (*isrfunc)(void)=gpio[pin].isrfunc;
+			if (isrfunc && value!=last) {
+				if (gpio[pin].isrmode==INT_EDGE_BOTH ||
+				   (gpio[pin].isrmode==INT_EDGE_RISING && value) ||
+				   (gpio[pin].isrmode==INT_EDGE_FALLING && !value)) isrfunc();
+			}
+		}
+		//Tail is moved after the ISR => drivers know when the edge is fully processed
+		__atomic_store_n(&shm->tail, pos, __ATOMIC_RELEASE);
+	}
+	wpiemu_edge_tsus=0;
+}
 
-//POSIX RT Signal Handling
+void * wpiemu_thread(void *arg) {
+	while (1) {
+		while (sem_wait(&wpiemu_shm->edges_sem)!=0 && errno==EINTR);
+		wpiemu_dispatch_edges(wpiemu_shm);
+	}
+	return NULL;
+}
+
+//POSIX RT Signal Handling => SIGRTMIN + pin*2 + value
 void signal_handler(int signo) {
 	if (signo>=SIGRTMIN && signo<=SIGRTMAX) {
 		int pin=(signo-SIGRTMIN);
 		int val=pin&0x01;
 		pin=pin>>1;
-		gpio[pin].status=val;
-		if (gpio[pin].isrfunc) gpio[pin].isrfunc();
-		//printf("INFO WiringPiEmu: Received GPIO %d => %d\n",pin,val);
+		if (wpiemu_push_edge(wpiemu_shm, pin, val, 0)) wpiemu_notify(wpiemu_shm);
+	}
+}
+
+//-------------------------------------------------------------------
+// Expansion nodes
+//-------------------------------------------------------------------
+
+struct wiringPiNodeStruct *wiringPiNodes=NULL;
+
+struct wiringPiNodeStruct *wiringPiFindNode(int pin) {
+	struct wiringPiNodeStruct *node=wiringPiNodes;
+	while (node) {
+		if (pin>=node->pinBase && pin<=node->pinMax) return node;
+		node=node->next;
+	}
+	return NULL;
+}
+
+struct wiringPiNodeStruct *wiringPiNewNode(int pinBase, int numPins) {
+	if (pinBase<64 || pinBase+numPins>WPIEMU_NUM_PINS) {
+		printf("ERROR WiringPiEmu: node pins (%d-%d) are out of range\n", pinBase, pinBase+numPins-1);
+		return NULL;
+	}
+	if (wiringPiFindNode(pinBase) || wiringPiFindNode(pinBase+numPins-1)) {
+		printf("ERROR WiringPiEmu: node pins (%d-%d) are already in use\n", pinBase, pinBase+numPins-1);
+		return NULL;
 	}
+	struct wiringPiNodeStruct *node=calloc(1, sizeof(struct wiringPiNodeStruct));
+	node->pinBase=pinBase;
+	node->pinMax=pinBase+numPins-1;
+	node->fd=-1;
+	node->next=wiringPiNodes;
+	wiringPiNodes=node;
+	return node;
+}
+
+//The emulated chip (zyni2cemu) may have created the node already
+int wpiemu_expander_setup(int pinBase, int numPins, int i2cAddress) {
+	struct wiringPiNodeStruct *node=wiringPiFindNode(pinBase);
+	if (!node) node=wiringPiNewNode(pinBase, numPins);
+	if (!node) return 0;
+	node->fd=i2cAddress;
+	return 1;
 }
 
 //-------------------------------------------------------------------
@@ -65,16 +230,22 @@ void signal_handler(int signo) {
 int wiringPiSetup(void) {
 	int i,signo;
 	//Reset GPIO Data Structures
-	for (i=0;i<GPIO_MAX;i++) {
+	for (i=0;i<WPIEMU_NUM_PINS;i++) {
 		gpio[i].pin=i;
 		gpio[i].pinmode=INPUT;
 		gpio[i].pullUpDnCtr=PUD_OFF;
 		gpio[i].isrmode=INT_EDGE_SETUP;
 		gpio[i].isrfunc=NULL;
-		gpio[i].status=0;
+	}
+	if (!wpiemu_shm) {
+		wpiemu_shm=wpiemu_create();
+		int err=pthread_create(&wpiemu_tid, NULL, &wpiemu_thread, NULL);
+		if (err != 0) {
+			printf("ERROR WiringPiEmu: Can't create edges thread :[%s]\n", strerror(err));
+		}
 	}
 	//Setup Signal Catching for GPIO Emulation
-	for (i=0;i<2*GPIO_MAX;i++) {
+	for (i=0;i<=SIGRTMAX-SIGRTMIN;i++) {
 		signo=SIGRTMIN+i;
 		if (signal(signo,signal_handler)==SIG_ERR) {
 			printf("ERROR WiringPiEmu: Can't catch signal %d\n",signo);
@@ -83,12 +254,16 @@ int wiringPiSetup(void) {
 	return 1;
 }
 
-int mcp23008Setup(int pin_offset, int addr_base) {
-	return 1;
+int mcp23008Setup(int pinBase, int i2cAddress) {
+	return wpiemu_expander_setup(pinBase, 8, i2cAddress);
+}
+
+int mcp23017Setup(int pinBase, int i2cAddress) {
+	return wpiemu_expander_setup(pinBase, 16, i2cAddress);
 }
 
 void pinMode(int pin, int mode) {
-	if (pin>=GPIO_MAX) {
+	if (pin<0 || pin>=WPIEMU_NUM_PINS) {
 		printf("ERROR WiringPiEmu: pin number (%d) is out of range\n",pin);
 		return;
 	}
@@ -96,34 +271,34 @@ void pinMode(int pin, int mode) {
 }
 
 void pullUpDnControl(int pin, int pud) {
-	if (pin>=GPIO_MAX) {
+	if (pin<0 || pin>=WPIEMU_NUM_PINS) {
 		printf("ERROR WiringPiEmu: pin number (%d) is out of range\n",pin);
 		return;
 	}
 	gpio[pin].pullUpDnCtr=pud;
-	if (pud==PUD_UP) gpio[pin].status=1;
-	else gpio[pin].status=0;
+	if (pud==PUD_UP) wpiemu_shm->levels[pin]=1;
+	else wpiemu_shm->levels[pin]=0;
 }
 
 void digitalWrite(int pin, int value) {
-	if (pin>=GPIO_MAX) {
+	if (pin<0 || pin>=WPIEMU_NUM_PINS) {
 		printf("ERROR WiringPiEmu: pin number (%d) is out of range\n",pin);
 		return;
 	}
 	//if (gpio_status[pin].pinmode==OUTPUT)
-	gpio[pin].status=value;
+	wpiemu_shm->levels[pin]=value ? 1 : 0;
 }
 
 int digitalRead(int pin) {
-	if (pin>=GPIO_MAX) {
+	if (pin<0 || pin>=WPIEMU_NUM_PINS) {
 		printf("ERROR WiringPiEmu: pin number (%d) is out of range\n",pin);
 		return 0;
 	}
-	return gpio[pin].status;
+	return wpiemu_shm->levels[pin];
 }
 
 int wiringPiISR(int pin, int mode, void (*function)(void)) {
-	if (pin>=GPIO_MAX) {
+	if (pin<0 || pin>=WPIEMU_NUM_PINS) {
 		printf("ERROR WiringPiEmu: pin number (%d) is out of range\n",pin);
 		return 0;
 	}
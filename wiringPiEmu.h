@@ -2,7 +2,10 @@
  * ******************************************************************
  * ZYNTHIAN PROJECT: WiringPi Emulation Library
  * 
- * Emulates WiringPi library using POSIX RT signals
+ * Emulates WiringPi library using a shared-memory virtual GPIO.
+ * Pin levels & an edge FIFO live in a shared-memory region, so an
+ * external driver can inject timestamped edges. ISRs are run from
+ * a normal thread. POSIX RT signals are still accepted as input.
  * 
  * Copyright (C) 2015-2016 Fernando Moyano <jofemodo@zynthian.org>
  *
@@ -23,6 +26,113 @@
  * ******************************************************************
  */
 
+#include <stdint.h>
+#include <semaphore.h>
+
+//-------------------------------------------------------------------
+// Shared-memory virtual GPIO
+//-------------------------------------------------------------------
+
+#define WPIEMU_SHM_NAME "/zynthian_wiringPiEmu"
+#define WPIEMU_SHM_MAGIC 0x5A59475E
+#define WPIEMU_SHM_VERSION 1
+
+// pins 0-255 => native & expanded (MCP23008 100-107) pins
+#define WPIEMU_NUM_PINS 256
+// edge FIFO size (power of 2)
+#define WPIEMU_FIFO_SIZE 65536
+
+struct wpiemu_edge_st {
+	volatile uint32_t seq;		// slot sequence (lock-free multi-producer FIFO)
+	uint16_t pin;
+	uint16_t value;
+	uint64_t tsus;				// edge time (CLOCK_MONOTONIC), 0 => now
+};
+
+struct wpiemu_shm_st {
+	uint32_t magic;
+	uint32_t version;
+	volatile uint8_t levels[WPIEMU_NUM_PINS];	// current pin levels
+	sem_t edges_sem;							// posted by producers after pushing edges
+	volatile uint32_t head;						// next slot to produce
+	volatile uint32_t tail;						// next slot to consume (moved when the ISR is done)
+	volatile uint64_t dropped;					// edges dropped because the FIFO was full
+	volatile uint64_t dispatched;				// edges dispatched to pins
+	struct wpiemu_edge_st edges[WPIEMU_FIFO_SIZE];
+};
+
+// Test driver API => attach to the region created by wiringPiSetup & inject edges.
+// wpiemu_push_edge returns 0 if the FIFO is full. Call wpiemu_notify after pushing a batch.
+struct wpiemu_shm_st *wpiemu_attach(void);
+int wpiemu_push_edge(struct wpiemu_shm_st *shm, uint16_t pin, uint16_t value, uint64_t tsus);
+void wpiemu_notify(struct wpiemu_shm_st *shm);
+
+// Time of the edge being dispatched, from the ISR (0 if not an injected edge)
+uint64_t wiringPiEmuEdgeTsus(void);
+
+//-------------------------------------------------------------------
+// Expansion nodes
+//-------------------------------------------------------------------
+
+// Pins from 64 up are owned by nodes (I2C expanders), like in wiringPi.
+// pinChanged is called from the edges thread when an edge changes a node pin,
+// so emulated devices (zyni2cemu) can follow their input pins.
+struct wiringPiNodeStruct {
+	int pinBase;
+	int pinMax;
+	int fd;						// I2C address
+	void (*pinChanged)(struct wiringPiNodeStruct *node, int pin, int value, uint64_t tsus);
+	void *data;
+	struct wiringPiNodeStruct *next;
+};
+
+// MCP23x08 & MCP23x17 registers (IOCON.BANK=0), as in wiringPi's mcp23x0817.h
+
+#define	MCP23x08_IODIR		0x00
+#define	MCP23x08_IPOL		0x01
+#define	MCP23x08_GPINTEN	0x02
+#define	MCP23x08_DEFVAL		0x03
+#define	MCP23x08_INTCON		0x04
+#define	MCP23x08_IOCON		0x05
+#define	MCP23x08_GPPU		0x06
+#define	MCP23x08_INTF		0x07
+#define	MCP23x08_INTCAP		0x08
+#define	MCP23x08_GPIO		0x09
+#define	MCP23x08_OLAT		0x0A
+
+#define	MCP23x17_IODIRA		0x00
+#define	MCP23x17_IPOLA		0x02
+#define	MCP23x17_GPINTENA	0x04
+#define	MCP23x17_DEFVALA	0x06
+#define	MCP23x17_INTCONA	0x08
+#define	MCP23x17_IOCON		0x0A
+#define	MCP23x17_GPPUA		0x0C
+#define	MCP23x17_INTFA		0x0E
+#define	MCP23x17_INTCAPA	0x10
+#define	MCP23x17_GPIOA		0x12
+#define	MCP23x17_OLATA		0x14
+
+#define	MCP23x17_IODIRB		0x01
+#define	MCP23x17_IPOLB		0x03
+#define	MCP23x17_GPINTENB	0x05
+#define	MCP23x17_DEFVALB	0x07
+#define	MCP23x17_INTCONB	0x09
+#define	MCP23x17_IOCONB		0x0B
+#define	MCP23x17_GPPUB		0x0D
+#define	MCP23x17_INTFB		0x0F
+#define	MCP23x17_INTCAPB	0x11
+#define	MCP23x17_GPIOB		0x13
+#define	MCP23x17_OLATB		0x15
+
+#define	IOCON_UNUSED	0x01
+#define	IOCON_INTPOL	0x02
+#define	IOCON_ODR	0x04
+#define	IOCON_HAEN	0x08
+#define	IOCON_DISSLW	0x10
+#define	IOCON_SEQOP	0x20
+#define	IOCON_MIRROR	0x40
+#define	IOCON_BANK_MODE	0x80
+
 // Handy defines
 
 // Deprecated
@@ -78,6 +188,12 @@ extern "C" {
 	
 	extern int  wiringPiSetup       (void) ;
 	extern int  mcp23008Setup       (int, int) ;
+	extern int  mcp23017Setup       (int, int) ;
+
+	// Nodes
+
+	extern struct wiringPiNodeStruct *wiringPiNewNode  (int pinBase, int numPins) ;
+	extern struct wiringPiNodeStruct *wiringPiFindNode (int pin) ;
 
 	extern void pinMode             (int pin, int mode) ;
 	extern void pullUpDnControl     (int pin, int pud) ;
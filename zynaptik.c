@@ -32,14 +32,19 @@
 #include <time.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
 #include <stdbool.h> 
 
-#include <wiringPi.h>
-#include <wiringPiI2C.h>
-#include <mcp23017.h>
-#include <mcp23x0817.h>
-#include <ads1115.h>
-#include <MCP4728.h>
+#if defined(HAVE_WIRINGPI_LIB)
+	#include <wiringPi.h>
+	#include <mcp23017.h>
+	#include <mcp23x0817.h>
+	#include <MCP4728.h>
+#else
+	#include "wiringPiEmu.h"
+	#include "zyni2cemu.h"
+#endif
 
 #include "zyncoder.h"
 
@@ -52,10 +57,10 @@ struct wiringPiNodeStruct *zynaptik_mcp23017_node;
 
 // two ISR routines for the two banks
 void zynaptik_mcp23017_bankA_ISR() {
-	zyncoder_mcp23017_ISR(zynaptik_mcp23017_node, ZYNAPTIK_MCP23017_BASE_PIN, 0);
+	zyncoder_mcp23017_ISR(ZYNAPTIK_MCP23017_I2C_ADDRESS, ZYNAPTIK_MCP23017_BASE_PIN, 0);
 }
 void zynaptik_mcp23017_bankB_ISR() {
-	zyncoder_mcp23017_ISR(zynaptik_mcp23017_node, ZYNAPTIK_MCP23017_BASE_PIN, 1);
+	zyncoder_mcp23017_ISR(ZYNAPTIK_MCP23017_I2C_ADDRESS, ZYNAPTIK_MCP23017_BASE_PIN, 1);
 }
 void (*zynaptik_mcp23017_bank_ISRs[2])={
 	zynaptik_mcp23017_bankA_ISR,
@@ -66,25 +71,61 @@ void (*zynaptik_mcp23017_bank_ISRs[2])={
 // ADS1115 Stuff
 //-----------------------------------------------------------------------------
 
-void init_ads1115(uint16_t base_pin, uint16_t i2c_address) {
-	ads1115Setup(base_pin, i2c_address);
-	//set_ads1115_gain(base_pin, ADS115_GAIN_VREF_4_096);
-	set_ads1115_gain(base_pin, ADS115_GAIN_VREF_6_144);
-	set_ads1115_gain(base_pin+1, ADS115_RATE_860SPS);
+uint8_t ads1115_addr=0;
+uint16_t ads1115_config=0;
+volatile uint8_t ads1115_chan=0;
+
+//ADS1115 registers are big-endian, as the bus scheduler 16 bits helpers
+int write_ads1115_reg(uint8_t reg, uint16_t val) {
+	return zyni2c_write_reg16(ZYNI2C_PRIO_SENSOR, ads1115_addr, reg, val);
+}
+
+int16_t read_ads1115_reg(uint8_t reg) {
+	return (int16_t)zyni2c_read_reg16(ZYNI2C_PRIO_SENSOR, ads1115_addr, reg);
+}
+
+int init_ads1115(uint16_t i2c_address, uint8_t gain, uint8_t rate) {
+	ads1115_addr=i2c_address;
+	if (zyni2c_read_reg16(ZYNI2C_PRIO_SENSOR, ads1115_addr, ADS1115_REG_CONFIG)<0) {
+		fprintf(stderr,"Zyncoder: Can't open ADS1115 at %x\n", i2c_address);
+		return 0;
+	}
+	ads1115_config=ADS1115_CONFIG_PGA(gain) | ADS1115_CONFIG_MODE_CONTINUOUS | ADS1115_CONFIG_DR(rate) | ADS1115_CONFIG_COMP_QUE_1CONV;
+	//Use ALERT/RDY pin as "conversion ready" signal => Hi_thresh MSB=1, Lo_thresh MSB=0
+	write_ads1115_reg(ADS1115_REG_HI_THRESH, 0x8000);
+	write_ads1115_reg(ADS1115_REG_LO_THRESH, 0x0000);
+	//Start continuous conversions
+	set_ads1115_channel(0);
+	return 1;
+}
+
+//Writing the config register changes the input from the next conversion
+void set_ads1115_channel(uint8_t ch) {
+	ads1115_chan=ch;
+	write_ads1115_reg(ADS1115_REG_CONFIG, ads1115_config | ADS1115_CONFIG_MUX_SINGLE(ch));
 }
 
-void set_ads1115_gain(uint16_t base_pin, uint8_t gain) {
-	digitalWrite(base_pin, gain);
+int16_t read_ads1115_conversion() {
+	return read_ads1115_reg(ADS1115_REG_CONVERSION);
 }
 
 //-----------------------------------------------------------------------------
 // MCP4728 Stuff
 //-----------------------------------------------------------------------------
 
+//The MCP4728 library uses its own fd => its calls are run on the I2C bus thread
+
 void * mcp4728_chip;
+uint16_t mcp4728_addr;
+
+int _init_mcp4728(void *arg) {
+	mcp4728_chip = mcp4728_initialize(2, 3, -1, mcp4728_addr);
+	return 0;
+}
 
 void init_mcp4728(uint16_t i2c_address) {
-	mcp4728_chip = mcp4728_initialize(2, 3, -1, i2c_address);
+	mcp4728_addr = i2c_address;
+	zyni2c_call(ZYNI2C_PRIO_OUTPUT, _init_mcp4728, NULL);
 }
 
 //-----------------------------------------------------------------------------
@@ -96,77 +137,96 @@ void setup_zynaptik_cvin(uint8_t i, int midi_evt, uint8_t midi_chan, uint8_t mid
 	zyncvins[i].midi_evt = midi_evt;
 	zyncvins[i].midi_chan = midi_chan & 0xF;
 	zyncvins[i].midi_num = midi_num & 0x7F;
-	zyncvins[i].midi_val = 0;
+	setup_zynccmap(ZYNCCMAP_CVIN0 + i, midi_evt, midi_chan, midi_num);
+	set_zynccmap_range(ZYNCCMAP_CVIN0 + i, 0, 32767);
 	zyncvins[i].enabled = 1;
 }
 
 void disable_zynaptik_cvin(uint8_t i) {
 	zyncvins[i].enabled = 0;
+	disable_zynccmap(ZYNCCMAP_CVIN0 + i);
 }
 
 void set_k_cvin(float k) { k_cvin=k; }
 float get_k_cvin() { return k_cvin; }
 
+//Range, curve, deadband, smoothing & rate limit are managed by the CC map
 void zynaptik_cvin_to_midi(uint8_t i, uint16_t val) {
-	if (zyncvins[i].midi_evt==PITCH_BENDING) {
-		val>>=1;
-		//Send MIDI event to engines and ouput (ZMOPS)
-		internal_send_pitchbend_change(zyncvins[i].midi_chan, val);
-		zyncvins[i].midi_val=val;
-		return;
-	}
-	val>>=8;
-	if (val==zyncvins[i].midi_val) return;
-	//printf("ZYNAPTIK CV-IN [%d] => MIDI event %d, %d, %d\n", i, zyncvins[i].midi_evt, zyncvins[i].midi_num, val);
-	if (zyncvins[i].midi_evt==CTRL_CHANGE) {
-		//Send MIDI event to engines and ouput (ZMOPS)
-		internal_send_ccontrol_change(zyncvins[i].midi_chan, zyncvins[i].midi_num, val);
-		//Update zyncoders
-		midi_event_zyncoders(zyncvins[i].midi_chan, zyncvins[i].midi_num, val);
-		//Send MIDI event to UI
-		write_zynmidi_ccontrol_change(zyncvins[i].midi_chan, zyncvins[i].midi_num, val);
+	zynccmap_input(ZYNCCMAP_CVIN0 + i, val);
+}
+
+uint16_t get_zynaptik_cvin(uint8_t i) {
+	if (i>=MAX_NUM_ZYNCVINS) return 0;
+	return zyncvins[i].val;
+}
+
+int zynaptik_cvin_settle=0;
+
+//Process a finished conversion and start the next one (pipeline) => 1 if the input was switched
+int zynaptik_cvin_conversion() {
+	uint8_t i=ads1115_chan;
+	int val=read_ads1115_conversion();
+	//Converted from the previous input
+	if (zynaptik_cvin_settle>0) {
+		zynaptik_cvin_settle--;
+		return 0;
 	}
-	else if (zyncvins[i].midi_evt==CHAN_PRESS) {
-		//Send MIDI event to engines and ouput (ZMOPS)
-		internal_send_chan_press(zyncvins[i].midi_chan, val);
-	} 
-	zyncvins[i].midi_val = val;
+	//Switch to next input before processing, so it's converted meanwhile
+	uint8_t next=(i+1) % MAX_NUM_ZYNCVINS;
+	set_ads1115_channel(next);
+	zynaptik_cvin_settle=ZYNAPTIK_ADS1115_SETTLE_CONVERSIONS;
+
+	val=(int)(k_cvin*(6.144/5.0)*val);
+	if (val>32767) val=32767;
+	else if (val<0) val=0;
+	zyncvins[i].val=(uint16_t)val;
+	//printf("ZYNAPTIK CV-IN [%d] => %d\n", i, val);
+	if (zyncvins[i].enabled) zynaptik_cvin_to_midi(i,(uint16_t)val);
+	return 1;
 }
 
-void * poll_zynaptik_cvins(void *arg) {
-	int i, val;
+#ifdef ZYNAPTIK_ADS1115_ALRT_PIN
+//ALERT/RDY pulses on every finished conversion
+void zynaptik_ads1115_ISR() {
+	zynaptik_cvin_conversion();
+}
+#else
+//No ALERT/RDY line => time the conversions
+void * zynaptik_cvins_thread(void *arg) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 	while (1) {
-		for (i=0;i<MAX_NUM_ZYNCVINS;i++) {
-			if (zyncvins[i].enabled) {
-				pthread_mutex_lock(&zynaptik_cvin_lock);
-				val=analogRead(zyncvins[i].pin);
-				pthread_mutex_unlock(&zynaptik_cvin_lock);
-				val=(int)(k_cvin*(6.144/5.0)*val);
-				if (val>32767) val=32767;
-				else if (val<0) val=0;
-				//printf("ZYNAPTIK CV-IN [%d] => %d\n", i, val);
-				zynaptik_cvin_to_midi(i,(uint16_t)val);
-			}
+		ts.tv_nsec+=ADS1115_CONVERSION_US*1000;
+		if (ts.tv_nsec>=1000000000) {
+			ts.tv_nsec-=1000000000;
+			ts.tv_sec++;
 		}
-		usleep(POLL_ZYNAPTIK_CVINS_US);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)==EINTR);
+		//Input switched => the next conversions are timed from the config write
+		if (zynaptik_cvin_conversion()) clock_gettime(CLOCK_MONOTONIC, &ts);
 	}
 	return NULL;
 }
-
-pthread_t init_poll_zynaptik_cvins() {
-	if (pthread_mutex_init(&zynaptik_cvin_lock, NULL) != 0) {
-		fprintf(stderr,"Zyncoder: Zynaptik CV-IN mutex init failed\n");
-		return 0;
-    }
+#endif
+
+int init_zynaptik_cvins() {
+	if (!init_ads1115(ZYNAPTIK_ADS1115_I2C_ADDRESS, ADS115_GAIN_VREF_6_144, ADS1115_DR_860SPS)) return 0;
+	zynaptik_cvin_settle=ZYNAPTIK_ADS1115_SETTLE_CONVERSIONS;
+#ifdef ZYNAPTIK_ADS1115_ALRT_PIN
+	pinMode(ZYNAPTIK_ADS1115_ALRT_PIN, INPUT);
+	pullUpDnControl(ZYNAPTIK_ADS1115_ALRT_PIN, PUD_UP);
+	wiringPiISR(ZYNAPTIK_ADS1115_ALRT_PIN, INT_EDGE_FALLING, zynaptik_ads1115_ISR);
+	printf("Zyncoder: Zynaptik CV-IN using ADS1115 ALERT/RDY interrupt on pin %d\n", ZYNAPTIK_ADS1115_ALRT_PIN);
+#else
 	pthread_t tid;
-	int err=pthread_create(&tid, NULL, &poll_zynaptik_cvins, NULL);
+	int err=pthread_create(&tid, NULL, &zynaptik_cvins_thread, NULL);
 	if (err != 0) {
-		fprintf(stderr,"Zyncoder: Can't create zynaptik CV-IN poll thread :[%s]", strerror(err));
+		fprintf(stderr,"Zyncoder: Can't create zynaptik CV-IN thread :[%s]", strerror(err));
 		return 0;
-	} else {
-		printf("Zyncoder: Zynaptik CV-IN poll thread created successfully\n");
-		return tid;
 	}
+	printf("Zyncoder: Zynaptik CV-IN thread created successfully\n");
+#endif
+	return 1;
 }
 
 //-----------------------------------------------------------------------------
@@ -192,6 +252,8 @@ void setup_zynaptik_cvout(uint8_t i, int midi_evt, uint8_t midi_chan, uint8_t mi
 	}
 
 	zyncvouts[i].val = 0;
+	zyncvouts[i].dac_val = 0;
+	zyncvouts[i].gate = 0;
 	zyncvouts[i].enabled = 1;
 }
 
@@ -204,6 +266,31 @@ float k_cvout=DEFAULT_K_CVOUT;
 void set_k_cvout(float k) { k_cvout=k; }
 float get_k_cvout() { return k_cvout; }
 
+//CV-OUT command queue, written from the jack thread & read by the CV-OUT worker
+jack_ringbuffer_t *zynaptik_cvout_queue=NULL;
+sem_t zynaptik_cvout_sem;
+int zynaptik_cvout_pending=0;
+
+void queue_zynaptik_cvout_cmd(uint8_t cmd, uint8_t i, uint16_t val) {
+	if (!zynaptik_cvout_queue) return;
+	struct zyncvout_cmd_st ev={ .cmd=cmd, .i=i, .val=val };
+	if (jack_ringbuffer_write_space(zynaptik_cvout_queue)<sizeof(ev)) {
+		//Don't print anything here => we are in the RT thread!
+		return;
+	}
+	jack_ringbuffer_write(zynaptik_cvout_queue, (const char *)&ev, sizeof(ev));
+	zynaptik_cvout_pending=1;
+}
+
+//Called from the jack thread, once per cycle, to wake up the CV-OUT worker
+void zynaptik_cvout_notify() {
+	if (zynaptik_cvout_pending) {
+		zynaptik_cvout_pending=0;
+		sem_post(&zynaptik_cvout_sem);
+	}
+}
+
+//Runs in the jack thread => No I2C, GPIO or sleeping here! Only queue commands.
 void zynaptik_midi_to_cvout(jack_midi_event_t *ev) {
 	uint8_t event_type= ev->buffer[0] >> 4;
 	if (event_type<NOTE_OFF || event_type>PITCH_BENDING) return;
@@ -217,90 +304,190 @@ void zynaptik_midi_to_cvout(jack_midi_event_t *ev) {
 
 		if (event_type==NOTE_ON && ev->buffer[2]>0) {
 			//printf("ZYNAPTIK MIDI TO CV-OUT NOTE-ON => %d, %d\n", ev->buffer[1], ev->buffer[2]);
-			if (zyncvouts[i].val>0) {
-				digitalWrite(zynswitches[zyncvouts[i].midi_num].pin,1);
-			}
 			zyncvouts[i].val=ev->buffer[1]<<7;
-			//set_zynaptik_cvout(i, zyncvouts[i].val);
-			refresh_zynaptik_cvouts();
-			usleep(50);
-			digitalWrite(zynswitches[zyncvouts[i].midi_num].pin,0);
+			queue_zynaptik_cvout_cmd(CVOUT_CMD_NOTE_ON, i, zyncvouts[i].val);
 		}
 		else if (event_type==NOTE_OFF || event_type==NOTE_ON) {
 			//printf("ZYNAPTIK MIDI TO CV-OUT NOTE-OFF => %d\n", ev->buffer[1]);
 			if (zyncvouts[i].val==ev->buffer[1]<<7) {
 				zyncvouts[i].val=0;
-				//set_zynaptik_cvout(i, zyncvouts[i].val);
-				refresh_zynaptik_cvouts();
-				digitalWrite(zynswitches[zyncvouts[i].midi_num].pin,1);
+				queue_zynaptik_cvout_cmd(CVOUT_CMD_NOTE_OFF, i, 0);
 			}
 		}
 		else if (event_type==PITCH_BENDING) {
 			zyncvouts[i].val=(ev->buffer[2]<<7) | ev->buffer[1];
-			//set_zynaptik_cvout(i, zyncvouts[i].val);
-			refresh_zynaptik_cvouts();
+			queue_zynaptik_cvout_cmd(CVOUT_CMD_VAL, i, zyncvouts[i].val);
 		}
 		else if (event_type==CTRL_CHANGE) {
 			zyncvouts[i].val=ev->buffer[2]<<7;
-			//set_zynaptik_cvout(i, zyncvouts[i].val);
-			refresh_zynaptik_cvouts();
+			queue_zynaptik_cvout_cmd(CVOUT_CMD_VAL, i, zyncvouts[i].val);
 		}
 		else if (event_type==CHAN_PRESS) {
 			zyncvouts[i].val=ev->buffer[2]<<7;
-			//set_zynaptik_cvout(i, zyncvouts[i].val);
-			refresh_zynaptik_cvouts();
+			queue_zynaptik_cvout_cmd(CVOUT_CMD_VAL, i, zyncvouts[i].val);
 		} 
 	}
 }
 
+struct mcp4728_single_st {
+	int i;
+	float vout;
+};
+
+int _set_zynaptik_cvout(void *arg) {
+	struct mcp4728_single_st *single=arg;
+	return mcp4728_singleexternal(mcp4728_chip, single->i, single->vout, 0);
+}
+
 void set_zynaptik_cvout(int i, uint16_t val) {
-	float vout=k_cvout*val/16384.0;
-	//printf("ZYNAPTIK CV-OUT %d => %f\n", i, vout);
-	int err=mcp4728_singleexternal(mcp4728_chip, i, vout, 0);
+	struct mcp4728_single_st single;
+	single.i=i;
+	single.vout=k_cvout*val/16384.0;
+	//printf("ZYNAPTIK CV-OUT %d => %f\n", i, single.vout);
+	int err=zyni2c_call(ZYNI2C_PRIO_OUTPUT, _set_zynaptik_cvout, &single);
 	if (err!=0) {
 		fprintf(stderr,"ZYNAPTIK CV-OUT => Can't write MCP4728 (DAC) register %d. ERROR %d\n", i, err);
 	}
 }
 
+int _refresh_zynaptik_cvouts(void *buffer) {
+	//return mcp4728_multipleinternal(mcp4728_chip, (float *)buffer, 0);
+	return mcp4728_multipleexternal(mcp4728_chip, (float *)buffer, 0);
+}
+
 void refresh_zynaptik_cvouts() {
 	int i, err;
 	float buffer[MAX_NUM_ZYNCVOUTS];
 	for (i=0;i<MAX_NUM_ZYNCVOUTS;i++) {
 		if (zyncvouts[i].enabled) {
-			buffer[i] = k_cvout*zyncvouts[i].val/16384.0;
+			buffer[i] = k_cvout*zyncvouts[i].dac_val/16384.0;
 		} else {
 			buffer[i] = 0;
 		}
 	}
 	//printf("ZYNAPTIK CV-OUT => [%f, %f, %f, %f]\n", buffer[0], buffer[1], buffer[2], buffer[3]);
-	//err=mcp4728_multipleinternal(mcp4728_chip, buffer, 0);
-	err=mcp4728_multipleexternal(mcp4728_chip, buffer, 0);
+	err=zyni2c_call(ZYNI2C_PRIO_OUTPUT, _refresh_zynaptik_cvouts, buffer);
 	if (err!=0) {
 		fprintf(stderr,"ZYNAPTIK CV-OUT => Can't write MCP4728 (DAC) registers. ERROR %d\n", err);
 	}
 }
 
-/*
-void * _refresh_zynaptik_cvouts(void *arg) {
+//Output latches of the Zynaptik's MCP23017, for writing gates directly
+uint8_t zynaptik_mcp23017_olat[2];
+
+//Gate pins are active low
+void set_zynaptik_cvout_gate(uint8_t i, uint8_t gate) {
+	int pin=zynswitches[zyncvouts[i].midi_num].pin;
+	if (pin>=ZYNAPTIK_MCP23017_BASE_PIN && pin<ZYNAPTIK_MCP23017_BASE_PIN+16) {
+		uint8_t bank=(pin-ZYNAPTIK_MCP23017_BASE_PIN)>>3;
+		uint8_t mask=1<<((pin-ZYNAPTIK_MCP23017_BASE_PIN) & 0x7);
+		if (gate) zynaptik_mcp23017_olat[bank]&=~mask;
+		else zynaptik_mcp23017_olat[bank]|=mask;
+		zyni2c_write_reg8(ZYNI2C_PRIO_OUTPUT, ZYNAPTIK_MCP23017_I2C_ADDRESS, bank ? MCP23x17_OLATB : MCP23x17_OLATA, zynaptik_mcp23017_olat[bank]);
+	} else {
+		digitalWrite(pin, gate?0:1);
+	}
+	zyncvouts[i].gate=gate;
+}
+
+void zynaptik_cvout_sleep_until(struct timespec *ts, long dtus) {
+	ts->tv_nsec+=dtus*1000;
+	while (ts->tv_nsec>=1000000000) {
+		ts->tv_nsec-=1000000000;
+		ts->tv_sec++;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL)==EINTR);
+}
+
+#define CVOUT_GATE_NONE 0
+#define CVOUT_GATE_ON 1
+#define CVOUT_GATE_OFF 2
+#define CVOUT_GATE_PULSE 3
+
+void * zynaptik_cvout_worker(void *arg) {
+	int i;
+	struct zyncvout_cmd_st cmd;
+	uint8_t gate_req[MAX_NUM_ZYNCVOUTS];
+	struct timespec ts;
+
 	while (1) {
+		while (sem_wait(&zynaptik_cvout_sem)!=0);
+
+		//Coalesce all queued commands => last value per DAC channel
+		int dirty=0, gates_on=0, gates_pulse=0;
+		for (i=0;i<MAX_NUM_ZYNCVOUTS;i++) gate_req[i]=CVOUT_GATE_NONE;
+		while (jack_ringbuffer_read_space(zynaptik_cvout_queue)>=sizeof(cmd)) {
+			jack_ringbuffer_read(zynaptik_cvout_queue, (char *)&cmd, sizeof(cmd));
+			if (cmd.i>=MAX_NUM_ZYNCVOUTS) continue;
+			if (cmd.cmd==CVOUT_CMD_NOTE_ON) {
+				zyncvouts[cmd.i].dac_val=cmd.val;
+				gate_req[cmd.i]=CVOUT_GATE_ON;
+			}
+			else if (cmd.cmd==CVOUT_CMD_NOTE_OFF) {
+				//Note released in the same batch => keep the pitch & send a short gate pulse
+				if (gate_req[cmd.i]==CVOUT_GATE_ON) gate_req[cmd.i]=CVOUT_GATE_PULSE;
+				else {
+					zyncvouts[cmd.i].dac_val=cmd.val;
+					gate_req[cmd.i]=CVOUT_GATE_OFF;
+				}
+			}
+			else {
+				zyncvouts[cmd.i].dac_val=cmd.val;
+			}
+			dirty=1;
+		}
+		if (!dirty) continue;
+
+		//Close gates before changing CV => retrigger
+		for (i=0;i<MAX_NUM_ZYNCVOUTS;i++) {
+			if (gate_req[i]==CVOUT_GATE_NONE) continue;
+			if (gate_req[i]==CVOUT_GATE_OFF || zyncvouts[i].gate) set_zynaptik_cvout_gate(i, 0);
+			if (gate_req[i]==CVOUT_GATE_ON) gates_on=1;
+			else if (gate_req[i]==CVOUT_GATE_PULSE) gates_on=gates_pulse=1;
+		}
+
+		//Write all DAC channels in a single I2C transaction
 		refresh_zynaptik_cvouts();
-		usleep(REFRESH_ZYNAPTIK_CVOUTS_US);
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		//Open gates when CV is settled
+		if (gates_on) {
+			zynaptik_cvout_sleep_until(&ts, ZYNAPTIK_CVOUT_GATE_SETTLE_US);
+			for (i=0;i<MAX_NUM_ZYNCVOUTS;i++) {
+				if (gate_req[i]==CVOUT_GATE_ON || gate_req[i]==CVOUT_GATE_PULSE) set_zynaptik_cvout_gate(i, 1);
+			}
+		}
+		if (gates_pulse) {
+			zynaptik_cvout_sleep_until(&ts, ZYNAPTIK_CVOUT_GATE_MIN_US);
+			for (i=0;i<MAX_NUM_ZYNCVOUTS;i++) {
+				if (gate_req[i]==CVOUT_GATE_PULSE) set_zynaptik_cvout_gate(i, 0);
+			}
+		}
 	}
 	return NULL;
 }
 
-pthread_t init_refresh_zynaptik_cvouts() {
+pthread_t init_zynaptik_cvout_worker() {
+	zynaptik_cvout_queue=jack_ringbuffer_create(ZYNAPTIK_CVOUT_QUEUE_SIZE*sizeof(struct zyncvout_cmd_st));
+	// lock the buffer into memory, this is *NOT* realtime safe, do it before using the buffer!
+	if (jack_ringbuffer_mlock(zynaptik_cvout_queue)) {
+		fprintf(stderr,"Zyncoder: Error locking memory for zynaptik CV-OUT queue.\n");
+		return 0;
+	}
+	if (sem_init(&zynaptik_cvout_sem, 0, 0)!=0) {
+		fprintf(stderr,"Zyncoder: Zynaptik CV-OUT semaphore init failed\n");
+		return 0;
+	}
 	pthread_t tid;
-	int err=pthread_create(&tid, NULL, &_refresh_zynaptik_cvouts, NULL);
+	int err=pthread_create(&tid, NULL, &zynaptik_cvout_worker, NULL);
 	if (err != 0) {
-		fprintf(stderr,"Zyncoder: Can't create zynaptik CV-OUT refresh thread :[%s]", strerror(err));
+		fprintf(stderr,"Zyncoder: Can't create zynaptik CV-OUT worker thread :[%s]", strerror(err));
 		return 0;
 	} else {
-		printf("Zyncoder: Zynaptik CV-OUT refresh thread created successfully.\n");
+		printf("Zyncoder: Zynaptik CV-OUT worker thread created successfully\n");
 		return tid;
 	}
 }
-*/
 
 //-----------------------------------------------------------------------------
 // Zynaptik Library Initialization
@@ -310,6 +497,7 @@ int init_zynaptik() {
 	int i;
 	for (i=0;i<MAX_NUM_ZYNCVINS;i++) {
 		zyncvins[i].enabled=0;
+		zyncvins[i].val=0;
 	}
 	for (i=0;i<MAX_NUM_ZYNCVOUTS;i++) {
 		zyncvouts[i].enabled=0;
@@ -322,14 +510,15 @@ int init_zynaptik() {
 
 	if (strstr(ZYNAPTIK_CONFIG, "16xDIO")) {
 		zynaptik_mcp23017_node = init_mcp23017(ZYNAPTIK_MCP23017_BASE_PIN, ZYNAPTIK_MCP23017_I2C_ADDRESS, ZYNAPTIK_MCP23017_INTA_PIN, ZYNAPTIK_MCP23017_INTB_PIN, zynaptik_mcp23017_bank_ISRs);
+		zynaptik_mcp23017_olat[0]=zyni2c_read_reg8(ZYNI2C_PRIO_OUTPUT, ZYNAPTIK_MCP23017_I2C_ADDRESS, MCP23x17_OLATA);
+		zynaptik_mcp23017_olat[1]=zyni2c_read_reg8(ZYNI2C_PRIO_OUTPUT, ZYNAPTIK_MCP23017_I2C_ADDRESS, MCP23x17_OLATB);
 	}
 	if (strstr(ZYNAPTIK_CONFIG, "4xAD")) {
-		init_ads1115(ZYNAPTIK_ADS1115_BASE_PIN, ZYNAPTIK_ADS1115_I2C_ADDRESS);
-		init_poll_zynaptik_cvins();
+		init_zynaptik_cvins();
 	}
 	if (strstr(ZYNAPTIK_CONFIG, "4xDA") || 1) {
 		init_mcp4728(ZYNAPTIK_MCP4728_I2C_ADDRESS);
-		//init_refresh_zynaptik_cvouts();
+		init_zynaptik_cvout_worker();
 	}
 
 	return 1;
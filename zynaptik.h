@@ -69,8 +69,34 @@
 #define ADS115_RATE_475SPS 5
 #define ADS115_RATE_860SPS 6
 
-void init_ads1115(uint16_t base_pin, uint16_t i2c_address);
-void set_ads1115_gain(uint16_t base_pin, uint8_t gain);
+//ADS1115 registers & config fields, for direct (continuous mode) access
+#define ADS1115_REG_CONVERSION 0x00
+#define ADS1115_REG_CONFIG 0x01
+#define ADS1115_REG_LO_THRESH 0x02
+#define ADS1115_REG_HI_THRESH 0x03
+
+#define ADS1115_CONFIG_MUX_SINGLE(ch) ((0x4 | ((ch) & 0x3)) << 12)
+#define ADS1115_CONFIG_PGA(gain) (((gain) & 0x7) << 9)
+#define ADS1115_CONFIG_MODE_CONTINUOUS 0x0000
+#define ADS1115_CONFIG_DR(dr) (((dr) & 0x7) << 5)
+#define ADS1115_CONFIG_COMP_QUE_1CONV 0x0000
+
+//Data-rate field value for 860 SPS (register value, not wiringPi's index)
+#define ADS1115_DR_860SPS 7
+#define ADS1115_CONVERSION_US (1000000/860 + 50)
+
+//ALERT/RDY pin of the Zynaptik's ADS1115 => If not defined, conversions are timed
+//#define ZYNAPTIK_ADS1115_ALRT_PIN 
+
+//Conversions to discard after switching input channel => in continuous mode, the conversion
+//in progress when the config register is written is finished with the previous input
+#if !defined(ZYNAPTIK_ADS1115_SETTLE_CONVERSIONS)
+	#define ZYNAPTIK_ADS1115_SETTLE_CONVERSIONS 1
+#endif
+
+int init_ads1115(uint16_t i2c_address, uint8_t gain, uint8_t rate);
+void set_ads1115_channel(uint8_t ch);
+int16_t read_ads1115_conversion();
 
 //-----------------------------------------------------------------------------
 // MCP4728 Stuff
@@ -97,11 +123,11 @@ void init_mcp4728(uint16_t i2c_address);
 struct zyncvin_st {
 	uint8_t enabled;
 	uint16_t pin;
+	volatile uint16_t val;	// last conversion, scaled to 0-32767
 
 	int midi_evt;
 	uint8_t midi_chan;
 	uint8_t midi_num;
-	uint16_t midi_val;
 };
 struct zyncvin_st zyncvins[MAX_NUM_ZYNCVINS];
 
@@ -112,11 +138,10 @@ float get_k_cvin();
 void setup_zynaptik_cvin(uint8_t i, int midi_evt, uint8_t midi_chan, uint8_t midi_num);
 void disable_zynaptik_cvin(uint8_t i);
 void zynaptik_cvin_to_midi(uint8_t i, uint16_t val);
+uint16_t get_zynaptik_cvin(uint8_t i);
 
-//CV-IN Polling interval
-#define POLL_ZYNAPTIK_CVINS_US 40000
-pthread_mutex_t zynaptik_cvin_lock;
-pthread_t init_poll_zynaptik_cvins();
+//CV-IN engine: ADS1115 in continuous mode, rotating input channels on every conversion
+int init_zynaptik_cvins();
 
 //-----------------------------------------------------------------------------
 // CV-OUT: Set Analog Outputs from MIDI: CC, Notes (velocity+pitchbend)
@@ -135,7 +160,9 @@ struct zyncvout_st {
 	uint16_t midi_event_temp;
 	uint16_t midi_event_mask;
 
-	uint16_t val;
+	uint16_t val;		// value tracked by the MIDI (jack) thread
+	uint16_t dac_val;	// value written to the DAC by the CV-OUT worker
+	uint8_t gate;		// gate status, as set by the CV-OUT worker
 };
 struct zyncvout_st zyncvouts[MAX_NUM_ZYNCVOUTS];
 
@@ -152,6 +179,29 @@ void refresh_zynaptik_cvouts();
 //CV-OUT Refresh interval
 #define REFRESH_ZYNAPTIK_CVOUTS_US 40000
 
+//CV-OUT worker: MIDI events are converted to commands in the jack thread
+//and queued (lock-free) to a dedicated thread that drives the DAC & gates.
+#define ZYNAPTIK_CVOUT_QUEUE_SIZE 256
+//Time between CV update and gate opening (us)
+#define ZYNAPTIK_CVOUT_GATE_SETTLE_US 50
+//Minimum gate length for notes released in the same cycle (us)
+#define ZYNAPTIK_CVOUT_GATE_MIN_US 1000
+
+enum zyncvout_cmd_enum {
+	CVOUT_CMD_VAL=0,
+	CVOUT_CMD_NOTE_ON=1,
+	CVOUT_CMD_NOTE_OFF=2
+};
+
+struct zyncvout_cmd_st {
+	uint8_t cmd;
+	uint8_t i;
+	uint16_t val;
+};
+
+void zynaptik_cvout_notify();
+pthread_t init_zynaptik_cvout_worker();
+
 //-----------------------------------------------------------------------------
 // Zynaptik Library Initialization
 //-----------------------------------------------------------------------------
@@ -0,0 +1,350 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Continuous-Controller Mapping Library
+ *
+ * Maps values from analog sources (CV-IN, TOF sensors, HWC pots)
+ * to MIDI continuous controllers: range, response curve, deadband,
+ * smoothing and output rate limit.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "zyncoder.h"
+
+//-----------------------------------------------------------------------------
+// Curve tables
+//-----------------------------------------------------------------------------
+
+void set_zynccmap_lut(struct zynccmap_st *ccmap, uint8_t curve) {
+	int k;
+	double x;
+	for (k=0;k<=ZYNCCMAP_LUT_SEGMENTS;k++) {
+		x=(double)k/ZYNCCMAP_LUT_SEGMENTS;
+		if (curve==ZYNCCMAP_CURVE_LOG) x=log10(1.0+9.0*x);
+		else if (curve==ZYNCCMAP_CURVE_EXP) x=(pow(10.0,x)-1.0)/9.0;
+		ccmap->lut[k]=(uint16_t)(16383.0*x+0.5);
+	}
+	ccmap->curve=curve;
+}
+
+//-----------------------------------------------------------------------------
+// Map configuration
+//-----------------------------------------------------------------------------
+
+pthread_mutex_t zynccmap_lock=PTHREAD_MUTEX_INITIALIZER;
+sem_t zynccmap_flush_sem;
+pthread_t zynccmap_flush_tid=0;
+
+pthread_t init_zynccmap_flush_thread();
+
+void init_zynccmaps() {
+	int i;
+	for (i=0;i<MAX_NUM_ZYNCCMAPS;i++) {
+		zynccmaps[i].enabled=0;
+		zynccmaps[i].in_min=0;
+		zynccmaps[i].in_max=16383;
+		zynccmaps[i].pending_val14=-1;
+		zynccmaps[i].pending_val=-1;
+		set_zynccmap_lut(zynccmaps+i, ZYNCCMAP_CURVE_LINEAR);
+	}
+	if (!zynccmap_flush_tid) zynccmap_flush_tid=init_zynccmap_flush_thread();
+}
+
+int setup_zynccmap(uint8_t i, int midi_evt, uint8_t midi_chan, uint8_t midi_num) {
+	if (i>=MAX_NUM_ZYNCCMAPS) {
+		fprintf(stderr, "ZynCCMap: Bad map index (%d).\n", i);
+		return 0;
+	}
+	struct zynccmap_st *ccmap=zynccmaps+i;
+	ccmap->enabled=0;
+	ccmap->midi_evt=midi_evt;
+	ccmap->midi_chan=midi_chan & 0xF;
+	ccmap->midi_num=midi_num & 0x7F;
+	ccmap->deadband=ZYNCCMAP_DEFAULT_DEADBAND;
+	ccmap->smooth=ZYNCCMAP_DEFAULT_SMOOTH;
+	ccmap->min_dtus=ZYNCCMAP_DEFAULT_MIN_DTUS;
+	ccmap->avg=INT32_MIN;
+	ccmap->last_val14=-1;
+	ccmap->last_val=-1;
+	ccmap->tsus=0;
+	ccmap->pending_val14=-1;
+	ccmap->pending_val=-1;
+	ccmap->enabled=1;
+	return 1;
+}
+
+void disable_zynccmap(uint8_t i) {
+	if (i>=MAX_NUM_ZYNCCMAPS) return;
+	pthread_mutex_lock(&zynccmap_lock);
+	zynccmaps[i].enabled=0;
+	zynccmaps[i].pending_val14=-1;
+	zynccmaps[i].pending_val=-1;
+	pthread_mutex_unlock(&zynccmap_lock);
+}
+
+int set_zynccmap_range(uint8_t i, int32_t in_min, int32_t in_max) {
+	if (i>=MAX_NUM_ZYNCCMAPS) {
+		fprintf(stderr, "ZynCCMap: Bad map index (%d).\n", i);
+		return 0;
+	}
+	if (in_min==in_max) {
+		fprintf(stderr, "ZynCCMap: Bad input range (%d, %d).\n", in_min, in_max);
+		return 0;
+	}
+	zynccmaps[i].in_min=in_min;
+	zynccmaps[i].in_max=in_max;
+	return 1;
+}
+
+int set_zynccmap_curve(uint8_t i, uint8_t curve) {
+	if (i>=MAX_NUM_ZYNCCMAPS) {
+		fprintf(stderr, "ZynCCMap: Bad map index (%d).\n", i);
+		return 0;
+	}
+	if (curve>=ZYNCCMAP_CURVE_TABLE) {
+		fprintf(stderr, "ZynCCMap: Bad curve preset (%d).\n", curve);
+		return 0;
+	}
+	set_zynccmap_lut(zynccmaps+i, curve);
+	return 1;
+}
+
+//Table values are 7 bits => scaled to 14 bits. Last point is extrapolated.
+int set_zynccmap_curve_table(uint8_t i, uint8_t table[128]) {
+	if (i>=MAX_NUM_ZYNCCMAPS) {
+		fprintf(stderr, "ZynCCMap: Bad map index (%d).\n", i);
+		return 0;
+	}
+	int k;
+	struct zynccmap_st *ccmap=zynccmaps+i;
+	for (k=0;k<ZYNCCMAP_LUT_SEGMENTS;k++) {
+		ccmap->lut[k]=(uint16_t)(table[k] & 0x7F) << 7;
+	}
+	ccmap->lut[ZYNCCMAP_LUT_SEGMENTS]=(table[127]==127) ? 16383 : (uint16_t)(table[127] & 0x7F) << 7;
+	ccmap->curve=ZYNCCMAP_CURVE_TABLE;
+	return 1;
+}
+
+int set_zynccmap_deadband(uint8_t i, uint16_t deadband) {
+	if (i>=MAX_NUM_ZYNCCMAPS) {
+		fprintf(stderr, "ZynCCMap: Bad map index (%d).\n", i);
+		return 0;
+	}
+	zynccmaps[i].deadband=deadband;
+	return 1;
+}
+
+int set_zynccmap_smooth(uint8_t i, uint8_t smooth) {
+	if (i>=MAX_NUM_ZYNCCMAPS) {
+		fprintf(stderr, "ZynCCMap: Bad map index (%d).\n", i);
+		return 0;
+	}
+	if (smooth>8) smooth=8;
+	zynccmaps[i].smooth=smooth;
+	return 1;
+}
+
+//0 => unlimited
+int set_zynccmap_max_rate(uint8_t i, unsigned int max_hz) {
+	if (i>=MAX_NUM_ZYNCCMAPS) {
+		fprintf(stderr, "ZynCCMap: Bad map index (%d).\n", i);
+		return 0;
+	}
+	if (max_hz>0) zynccmaps[i].min_dtus=1000000/max_hz;
+	else zynccmaps[i].min_dtus=0;
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Map processing
+//-----------------------------------------------------------------------------
+
+void send_zynccmap_midi(struct zynccmap_st *ccmap, int val) {
+	if (ccmap->midi_evt==PITCH_BENDING) {
+		//Send MIDI event to engines and ouput (ZMOPS)
+		internal_send_pitchbend_change(ccmap->midi_chan, val);
+	}
+	else if (ccmap->midi_evt==CTRL_CHANGE) {
+		//Send MIDI event to engines and ouput (ZMOPS)
+		internal_send_ccontrol_change(ccmap->midi_chan, ccmap->midi_num, val);
+		//Update zyncoders
+		midi_event_zyncoders(ccmap->midi_chan, ccmap->midi_num, val);
+		//Send MIDI event to UI
+		write_zynmidi_ccontrol_change(ccmap->midi_chan, ccmap->midi_num, val);
+	}
+	else if (ccmap->midi_evt==CHAN_PRESS) {
+		//Send MIDI event to engines and ouput (ZMOPS)
+		internal_send_chan_press(ccmap->midi_chan, val);
+	}
+}
+
+unsigned long zynccmap_get_tsus() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+//Must be called with zynccmap_lock held
+void send_zynccmap_value(struct zynccmap_st *ccmap, int val14, int mval, unsigned long tsus) {
+	ccmap->last_val14=val14;
+	ccmap->last_val=mval;
+	ccmap->tsus=tsus;
+	ccmap->pending_val14=-1;
+	ccmap->pending_val=-1;
+	send_zynccmap_midi(ccmap, mval);
+}
+
+int zynccmap_input(uint8_t i, int32_t val) {
+	if (i>=MAX_NUM_ZYNCCMAPS) return 0;
+	struct zynccmap_st *ccmap=zynccmaps+i;
+	if (!ccmap->enabled) return 0;
+
+	pthread_mutex_lock(&zynccmap_lock);
+
+	//Smoothing => exponential moving average
+	if (ccmap->avg==INT32_MIN || ccmap->smooth==0) ccmap->avg=val*256;
+	else ccmap->avg+=(val*256-ccmap->avg)>>ccmap->smooth;
+
+	//Range => normalized input (16 bits fixed point)
+	int32_t span=ccmap->in_max-ccmap->in_min;
+	int32_t x=(int32_t)((((int64_t)ccmap->avg-((int64_t)ccmap->in_min<<8))<<8)/span);
+	if (x<0) x=0;
+	else if (x>0xFFFF) x=0xFFFF;
+
+	//Curve => interpolate LUT
+	int k=x>>9;
+	int f=x & 0x1FF;
+	int val14=ccmap->lut[k]+(((ccmap->lut[k+1]-ccmap->lut[k])*f)>>9);
+
+	//Deadband / Hysteresis => always let extremes pass. A pending value is kept.
+	if (ccmap->last_val14>=0) {
+		if (val14==ccmap->last_val14 || (abs(val14-ccmap->last_val14)<=ccmap->deadband && val14!=ccmap->lut[0] && val14!=ccmap->lut[ZYNCCMAP_LUT_SEGMENTS])) {
+			pthread_mutex_unlock(&zynccmap_lock);
+			return 0;
+		}
+	}
+
+	//Output resolution => discard if nothing changes. Back to the sent value => nothing pending.
+	int mval=val14;
+	if (ccmap->midi_evt!=PITCH_BENDING) mval>>=7;
+	if (mval==ccmap->last_val) {
+		ccmap->pending_val14=-1;
+		ccmap->pending_val=-1;
+		pthread_mutex_unlock(&zynccmap_lock);
+		return 0;
+	}
+
+	//Rate limit => value is kept pending & sent by the flush thread when the interval expires
+	unsigned long tsus=zynccmap_get_tsus();
+	if (ccmap->min_dtus>0 && ccmap->last_val>=0 && tsus-ccmap->tsus<ccmap->min_dtus) {
+		int wake=(ccmap->pending_val<0);
+		ccmap->pending_val14=val14;
+		ccmap->pending_val=mval;
+		pthread_mutex_unlock(&zynccmap_lock);
+		if (wake && zynccmap_flush_tid) sem_post(&zynccmap_flush_sem);
+		return 0;
+	}
+
+	//printf("ZynCCMap [%d] => %d => %d\n", i, val, mval);
+	send_zynccmap_value(ccmap, val14, mval, tsus);
+	pthread_mutex_unlock(&zynccmap_lock);
+	return 1;
+}
+
+int zynccmap_flush(uint8_t i) {
+	if (i>=MAX_NUM_ZYNCCMAPS) return 0;
+	struct zynccmap_st *ccmap=zynccmaps+i;
+	int res=0;
+	pthread_mutex_lock(&zynccmap_lock);
+	if (ccmap->enabled && ccmap->pending_val>=0) {
+		unsigned long tsus=zynccmap_get_tsus();
+		if (tsus-ccmap->tsus>=ccmap->min_dtus) {
+			send_zynccmap_value(ccmap, ccmap->pending_val14, ccmap->pending_val, tsus);
+			res=1;
+		}
+	}
+	pthread_mutex_unlock(&zynccmap_lock);
+	return res;
+}
+
+//-----------------------------------------------------------------------------
+// Flush thread => sends the values held back by the rate limit
+//-----------------------------------------------------------------------------
+
+void * zynccmap_flush_thread(void *arg) {
+	int i;
+	long dtus, next_dtus;
+	unsigned long tsus;
+	struct timespec ts;
+	while (1) {
+		//Sleep until some value is held back
+		while (sem_wait(&zynccmap_flush_sem)!=0);
+		while (1) {
+			//Send the expired values & get the time to the earliest pending one
+			next_dtus=-1;
+			for (i=0;i<MAX_NUM_ZYNCCMAPS;i++) {
+				if (zynccmap_flush(i)) continue;
+				pthread_mutex_lock(&zynccmap_lock);
+				if (zynccmaps[i].enabled && zynccmaps[i].pending_val>=0) {
+					tsus=zynccmap_get_tsus();
+					dtus=zynccmaps[i].min_dtus-(long)(tsus-zynccmaps[i].tsus);
+					if (dtus<1) dtus=1;
+					if (next_dtus<0 || dtus<next_dtus) next_dtus=dtus;
+				}
+				pthread_mutex_unlock(&zynccmap_lock);
+			}
+			if (next_dtus<0) break;
+			//New inputs can't shorten the wait (the interval runs from the last sent value)
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec+=next_dtus*1000;
+			ts.tv_sec+=ts.tv_nsec/1000000000;
+			ts.tv_nsec%=1000000000;
+			while (sem_timedwait(&zynccmap_flush_sem, &ts)!=0) {
+				if (errno!=EINTR) break;
+			}
+		}
+	}
+	return NULL;
+}
+
+pthread_t init_zynccmap_flush_thread() {
+	if (sem_init(&zynccmap_flush_sem, 0, 0)!=0) {
+		fprintf(stderr, "ZynCCMap: Can't init flush semaphore.\n");
+		return 0;
+	}
+	pthread_t tid;
+	int err=pthread_create(&tid, NULL, &zynccmap_flush_thread, NULL);
+	if (err != 0) {
+		fprintf(stderr, "ZynCCMap: Can't create flush thread :[%s]\n", strerror(err));
+		return 0;
+	}
+	return tid;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,95 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Continuous-Controller Mapping Library
+ *
+ * Maps values from analog sources (CV-IN, TOF sensors, HWC pots)
+ * to MIDI continuous controllers: range, response curve, deadband,
+ * smoothing and output rate limit.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// Continuous-Controller Maps
+//-----------------------------------------------------------------------------
+
+//Map slots reserved for every analog source
+#define ZYNCCMAP_CVIN0 0
+#define ZYNCCMAP_TOF0 4
+#define ZYNCCMAP_POT0 8
+#define MAX_NUM_ZYNCCMAPS 24
+
+//Response curve presets
+#define ZYNCCMAP_CURVE_LINEAR 0
+#define ZYNCCMAP_CURVE_LOG 1
+#define ZYNCCMAP_CURVE_EXP 2
+#define ZYNCCMAP_CURVE_TABLE 3
+
+//Curve LUT: 128 segments, linearly interpolated
+#define ZYNCCMAP_LUT_SEGMENTS 128
+
+//Defaults => deadband is in 14 bits output units
+#define ZYNCCMAP_DEFAULT_DEADBAND 16
+#define ZYNCCMAP_DEFAULT_SMOOTH 2
+#define ZYNCCMAP_DEFAULT_MIN_DTUS 2000
+
+struct zynccmap_st {
+	uint8_t enabled;
+
+	int midi_evt;
+	uint8_t midi_chan;
+	uint8_t midi_num;
+
+	int32_t in_min;
+	int32_t in_max;
+	uint8_t curve;
+	uint16_t lut[ZYNCCMAP_LUT_SEGMENTS+1];
+	uint16_t deadband;
+	uint8_t smooth;
+	unsigned int min_dtus;
+
+	int32_t avg;			// smoothed input (fixed point, 8 bits fraction)
+	int last_val14;		// last sent value (14 bits), -1 if none
+	int last_val;			// last sent value (MIDI resolution)
+	unsigned long tsus;	// time of last sent value
+	int pending_val14;	// value held back by the rate limit (14 bits), -1 if none
+	int pending_val;		// value held back by the rate limit (MIDI resolution)
+};
+struct zynccmap_st zynccmaps[MAX_NUM_ZYNCCMAPS];
+
+void init_zynccmaps();
+
+int setup_zynccmap(uint8_t i, int midi_evt, uint8_t midi_chan, uint8_t midi_num);
+void disable_zynccmap(uint8_t i);
+int set_zynccmap_range(uint8_t i, int32_t in_min, int32_t in_max);
+int set_zynccmap_curve(uint8_t i, uint8_t curve);
+int set_zynccmap_curve_table(uint8_t i, uint8_t table[128]);
+int set_zynccmap_deadband(uint8_t i, uint16_t deadband);
+int set_zynccmap_smooth(uint8_t i, uint8_t smooth);
+int set_zynccmap_max_rate(uint8_t i, unsigned int max_hz);
+
+//Feed a new raw value from the source. Returns 1 if a MIDI event was sent.
+//Values held back by the rate limit are sent by the flush thread when the interval expires.
+int zynccmap_input(uint8_t i, int32_t val);
+//Send the pending value if the rate limit interval has expired. Returns 1 if a MIDI event was sent.
+int zynccmap_flush(uint8_t i);
+
+//-----------------------------------------------------------------------------
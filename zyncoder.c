@@ -42,31 +42,32 @@
 	#include <mcp23017.h>
 	#include <mcp23x0817.h>
 	#include <mcp23008.h>
+#else
+	#include "wiringPiEmu.h"
+#endif
 
-	#if defined(MCP23017_ENCODERS)
-		// pins 100-115 are located on the MCP23017
-		#define MCP23017_BASE_PIN 100
-		// define default I2C Address for MCP23017
-		#if !defined(MCP23017_I2C_ADDRESS)
-			#define MCP23017_I2C_ADDRESS 0x20
-		#endif
-		// define default interrupt pins for the MCP23017
-		#if !defined(MCP23017_INTA_PIN)
-			#define MCP23017_INTA_PIN 27
-		#endif
-		#if !defined(MCP23017_INTB_PIN)
-			#define MCP23017_INTB_PIN 25
-		#endif
-	#elif defined(MCP23008_ENCODERS)
-		// pins 100-107 are located on the MCP23008
-		#define MCP23008_BASE_PIN 100
-		#define MCP23008_I2C_ADDRESS 0x20
+#if defined(MCP23017_ENCODERS)
+	// pins 100-115 are located on the MCP23017
+	#define MCP23017_BASE_PIN 100
+	// define default I2C Address for MCP23017
+	#if !defined(MCP23017_I2C_ADDRESS)
+		#define MCP23017_I2C_ADDRESS 0x20
 	#endif
-
-#else
+	// define default interrupt pins for the MCP23017
+	#if !defined(MCP23017_INTA_PIN)
+		#define MCP23017_INTA_PIN 27
+	#endif
+	#if !defined(MCP23017_INTB_PIN)
+		#define MCP23017_INTB_PIN 25
+	#endif
+#elif defined(MCP23008_ENCODERS)
+	// pins 100-107 are located on the MCP23008
 	#define MCP23008_BASE_PIN 100
 	#define MCP23008_I2C_ADDRESS 0x20
-	#include "wiringPiEmu.h"
+	// with the INT pin wired, switches are captured on interrupt instead of polled
+	#if defined(MCP23008_INT_PIN)
+		#define MCP23008_INTERRUPT
+	#endif
 #endif
 
 #define bitRead(value, bit) (((value) >> (bit)) & 0x01)
@@ -81,6 +82,11 @@
 //-----------------------------------------------------------------------------
 
 int init_zynlib() {
+	init_zynccmaps();
+	if (!init_zyni2c()) return 0;
+	#if defined(ZYNGPIO_GPIOD)
+	if (!init_zyngpio()) return 0;
+	#endif
 	if (!init_zyncoder()) return 0;
 	if (!init_zynmidirouter()) return 0;
 	#ifdef ZYNAPTIK_CONFIG
@@ -103,6 +109,10 @@ int end_zynlib() {
 	#endif
 	if (!end_zynmidirouter()) return 0;
 	if (!end_zyncoder()) return 0;
+	#if defined(ZYNGPIO_GPIOD)
+	if (!end_zyngpio()) return 0;
+	#endif
+	if (!end_zyni2c()) return 0;
 	return 1;
 }
 
@@ -116,10 +126,10 @@ struct wiringPiNodeStruct *zyncoder_mcp23017_node;
 
 // two ISR routines for the two banks
 void zyncoder_mcp23017_bankA_ISR() {
-	zyncoder_mcp23017_ISR(zyncoder_mcp23017_node, MCP23017_BASE_PIN, 0);
+	zyncoder_mcp23017_ISR(MCP23017_I2C_ADDRESS, MCP23017_BASE_PIN, 0);
 }
 void zyncoder_mcp23017_bankB_ISR() {
-	zyncoder_mcp23017_ISR(zyncoder_mcp23017_node, MCP23017_BASE_PIN, 1);
+	zyncoder_mcp23017_ISR(MCP23017_I2C_ADDRESS, MCP23017_BASE_PIN, 1);
 }
 void (*zyncoder_mcp23017_bank_ISRs[2])={
 	zyncoder_mcp23017_bankA_ISR,
@@ -127,12 +137,24 @@ void (*zyncoder_mcp23017_bank_ISRs[2])={
 };
 
 #elif defined(MCP23008_ENCODERS)
-//Switch Polling interval
+#if defined(MCP23008_INTERRUPT)
+void init_mcp23008(int base_pin, uint8_t i2c_address, uint8_t int_pin, void (*isr)(void));
+
+// ISR routine for the MCP23008 INT pin
+void zyncoder_mcp23008_ISR() {
+	zyncoder_mcp23017_ISR(MCP23008_I2C_ADDRESS, MCP23008_BASE_PIN, 0);
+}
+#else
+//Switch Polling interval (idle)
 int poll_zynswitches_us=10000;
+//Fast polling interval, used for a while after some switch activity
+unsigned int poll_zynswitches_active_us=1000;
+unsigned long poll_zynswitches_active_time_us=500000;
 
 //Switches Polling Thread (should be avoided!)
 pthread_t init_poll_zynswitches();
 #endif
+#endif
 
 unsigned int int_to_int(unsigned int k) {
 	return (k == 0 || k == 1 ? k : ((k % 2) + 10 * int_to_int(k / 2)));
@@ -146,74 +168,92 @@ int init_zyncoder() {
 	}
 	for (i=0;i<MAX_NUM_ZYNCODERS;i++) {
 		zyncoders[i].enabled=0;
-		for (j=0;j<ZYNCODER_TICKS_PER_RETENT;j++) zyncoders[i].dtus[j]=0;
+		for (j=0;j<ZYNCODER_MAX_ACCEL_WINDOW;j++) zyncoders[i].dtus[j]=0;
+		zyncoders[i].dtus_sum=0;
+		zyncoders[i].dtus_pos=0;
+	}
+	for (i=0;i<MAX_NUM_MCP23017;i++) {
+		mcp23017s[i].enabled=0;
 	}
 	wiringPiSetup();
+	init_zyndebounce(zynswitches_debounce_expire);
 
 #if defined(MCP23017_ENCODERS)
 	zyncoder_mcp23017_node = init_mcp23017(MCP23017_BASE_PIN, MCP23017_I2C_ADDRESS, MCP23017_INTA_PIN, MCP23017_INTB_PIN, zyncoder_mcp23017_bank_ISRs);
 #elif defined(MCP23008_ENCODERS)   
 	mcp23008Setup(MCP23008_BASE_PIN, MCP23008_I2C_ADDRESS);
+#if defined(MCP23008_INTERRUPT)
+	init_mcp23008(MCP23008_BASE_PIN, MCP23008_I2C_ADDRESS, MCP23008_INT_PIN, zyncoder_mcp23008_ISR);
+#else
 	init_poll_zynswitches();
+#endif
 #endif
 	return 1;
 }
 
 int end_zyncoder() {
+	end_zyndebounce();
 	return 1;
 }
 
+#if !defined(MCP23008_ENCODERS) || defined(MCP23008_INTERRUPT)
+struct mcp23017_st *register_mcp23017(uint16_t base_pin, uint8_t i2c_address, uint8_t num_pins);
+#endif
+
 #ifndef MCP23008_ENCODERS 
+
 struct wiringPiNodeStruct * init_mcp23017(int base_pin, uint8_t i2c_address, uint8_t inta_pin, uint8_t intb_pin, void (*isrs[2])) {
 	uint8_t reg;
 
 	mcp23017Setup(base_pin, i2c_address);
+	register_mcp23017(base_pin, i2c_address, 16);
 
-	// get the node corresponding to our mcp23017 so we can do direct writes
+	// the node is kept for pin based access (pinMode, digitalWrite, etc.)
+	// direct register access is done through the I2C bus scheduler
 	struct wiringPiNodeStruct * mcp23017_node = wiringPiFindNode(base_pin);
 
 	// setup all the pins on the banks as inputs and disable pullups on
 	// the zyncoder input
 	reg = 0xff;
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_IODIRA, reg);
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_IODIRB, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_IODIRA, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_IODIRB, reg);
 
 	// enable pullups on the unused pins (high two bits on each bank)
 	reg = 0xff;
 	//reg = 0xc0;
 	//reg = 0x60;
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_GPPUA, reg);
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_GPPUB, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_GPPUA, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_GPPUB, reg);
 
 	// disable polarity inversion
 	reg = 0;
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_IPOLA, reg);
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_IPOLB, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_IPOLA, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_IPOLB, reg);
 
 	// disable the comparison to DEFVAL register
 	reg = 0;
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_INTCONA, reg);
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_INTCONB, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_INTCONA, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_INTCONB, reg);
 
 	// configure the interrupt behavior for bank A
-	uint8_t ioconf_value = wiringPiI2CReadReg8(mcp23017_node->fd, MCP23x17_IOCON);
+	uint8_t ioconf_value = zyni2c_read_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_IOCON);
 	bitWrite(ioconf_value, 6, 0);	// banks are not mirrored
 	bitWrite(ioconf_value, 2, 0);	// interrupt pin is not floating
 	bitWrite(ioconf_value, 1, 1);	// interrupt is signaled by high
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_IOCON, ioconf_value);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_IOCON, ioconf_value);
 
 	// configure the interrupt behavior for bank B
-	ioconf_value = wiringPiI2CReadReg8(mcp23017_node->fd, MCP23x17_IOCONB);
+	ioconf_value = zyni2c_read_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_IOCONB);
 	bitWrite(ioconf_value, 6, 0);	// banks are not mirrored
 	bitWrite(ioconf_value, 2, 0);	// interrupt pin is not floating
 	bitWrite(ioconf_value, 1, 1);	// interrupt is signaled by high
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_IOCONB, ioconf_value);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_IOCONB, ioconf_value);
 
 	// finally, enable the interrupt pins for banks a and b
 	// enable interrupts on all pins
 	reg = 0xff;
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_GPINTENA, reg);
-	wiringPiI2CWriteReg8(mcp23017_node->fd, MCP23x17_GPINTENB, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_GPINTENA, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_GPINTENB, reg);
 
 	// pi ISRs for the 23017
 	// bank A
@@ -222,8 +262,8 @@ struct wiringPiNodeStruct * init_mcp23017(int base_pin, uint8_t i2c_address, uin
 	wiringPiISR(intb_pin, INT_EDGE_RISING, isrs[1]);
 
 	//Read data for first time ...
-	wiringPiI2CReadReg8(mcp23017_node->fd, MCP23x17_GPIOA);
-	wiringPiI2CReadReg8(mcp23017_node->fd, MCP23x17_GPIOB);
+	zyni2c_read_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_GPIOA);
+	zyni2c_read_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x17_GPIOB);
 
 	#ifdef DEBUG
 	printf("MCP23017 at %x initialized in %d: INTA %d, INTB %d\n", i2c_address, base_pin, inta_pin, intb_pin);
@@ -233,6 +273,44 @@ struct wiringPiNodeStruct * init_mcp23017(int base_pin, uint8_t i2c_address, uin
 }
 #endif
 
+#if defined(MCP23008_INTERRUPT)
+void init_mcp23008(int base_pin, uint8_t i2c_address, uint8_t int_pin, void (*isr)(void)) {
+	uint8_t reg;
+
+	register_mcp23017(base_pin, i2c_address, 8);
+
+	// all the pins are inputs with pullups
+	reg = 0xff;
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x08_IODIR, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x08_GPPU, reg);
+
+	// disable polarity inversion & the comparison to DEFVAL register
+	reg = 0;
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x08_IPOL, reg);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x08_INTCON, reg);
+
+	// configure the interrupt behavior
+	uint8_t ioconf_value = zyni2c_read_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x08_IOCON);
+	bitWrite(ioconf_value, 2, 0);	// interrupt pin is not floating
+	bitWrite(ioconf_value, 1, 1);	// interrupt is signaled by high
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x08_IOCON, ioconf_value);
+
+	// enable interrupts on all pins
+	reg = 0xff;
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x08_GPINTEN, reg);
+
+	// pi ISR for the 23008
+	wiringPiISR(int_pin, INT_EDGE_RISING, isr);
+
+	//Read data for first time ...
+	zyni2c_read_reg8(ZYNI2C_PRIO_CONTROL, i2c_address, MCP23x08_GPIO);
+
+	#ifdef DEBUG
+	printf("MCP23008 at %x initialized in %d: INT %d\n", i2c_address, base_pin, int_pin);
+	#endif
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // GPIO Switches
 //-----------------------------------------------------------------------------
@@ -270,10 +348,9 @@ void send_zynswitch_midi(struct zynswitch_st *zynswitch, uint8_t status) {
 #ifdef ZYNAPTIK_CONFIG
 	else if (zynswitch->midi_event.type==CVGATE_IN_EVENT && zynswitch->midi_event.num<4) {
 		if (status==0) {
-			pthread_mutex_lock(&zynaptik_cvin_lock);
-			int val=analogRead(ZYNAPTIK_ADS1115_BASE_PIN + zynswitch->midi_event.num);
-			pthread_mutex_unlock(&zynaptik_cvin_lock);
-			zynswitch->last_cvgate_note=(int)((k_cvin*6.144/(5.0*256.0))*val);
+			//Last conversion from the CV-IN engine, already scaled by k_cvin
+			int val=get_zynaptik_cvin(zynswitch->midi_event.num);
+			zynswitch->last_cvgate_note=val>>8;
 			if (zynswitch->last_cvgate_note>127) zynswitch->last_cvgate_note=127;
 			else if (zynswitch->last_cvgate_note<0) zynswitch->last_cvgate_note=0;
 			//Send MIDI event to engines and ouput (ZMOPS)
@@ -302,42 +379,38 @@ void send_zynswitch_midi(struct zynswitch_st *zynswitch, uint8_t status) {
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Time source
+//-----------------------------------------------------------------------------
+
+zyncoder_clock_t zyncoder_clock=NULL;
+
+void set_zyncoder_clock(zyncoder_clock_t clock) {
+	zyncoder_clock=clock;
+	set_zyndebounce_clock(clock);
+}
+
+unsigned long zyncoder_get_tsus() {
+	if (zyncoder_clock) return zyncoder_clock();
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+//-----------------------------------------------------------------------------
 
 #ifdef MCP23008_ENCODERS
 //Update ISR switches (native GPIO)
 void update_zynswitch(uint8_t i) {
+	if (i>=MAX_NUM_ZYNSWITCHES) return;
+	update_zynswitch_state(i, digitalRead(zynswitches[i].pin), zyncoder_get_tsus());
+}
 #else
 // Update the mcp23017 based switches from ISR routine
 void update_zynswitch(uint8_t i, uint8_t status) {
-#endif
-	if (i>=MAX_NUM_ZYNSWITCHES) return;
-	struct zynswitch_st *zynswitch = zynswitches + i;
-	if (zynswitch->enabled==0) return;
-
-#ifdef MCP23008_ENCODERS
-	uint8_t status=digitalRead(zynswitch->pin);
-#endif
-	if (status==zynswitch->status) return;
-	zynswitch->status=status;
-
-	send_zynswitch_midi(zynswitch, status);
-
-	struct timespec ts;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	unsigned long int tsus=ts.tv_sec*1000000 + ts.tv_nsec/1000;
-
-	//printf("SWITCH ISR %d => STATUS=%d (%lu)\n",i,zynswitch->status,tsus);
-	if (zynswitch->status==1) {
-		if (zynswitch->tsus>0) {
-			unsigned int dtus=tsus-zynswitch->tsus;
-			zynswitch->tsus=0;
-			//Ignore spurious ticks
-			if (dtus<1000) return;
-			//printf("Debounced Switch %d\n",i);
-			zynswitch->dtus=dtus;
-		}
-	} else zynswitch->tsus=tsus;
+	update_zynswitch_state(i, status, zyncoder_get_tsus());
 }
+#endif
 
 #ifdef MCP23008_ENCODERS
 void update_zynswitch_0() { update_zynswitch(0); }
@@ -359,41 +432,47 @@ void (*update_zynswitch_funcs[8])={
 	update_zynswitch_7
 };
 
-//Update NON-ISR switches (expanded GPIO)
-void update_expanded_zynswitches() {
-	struct timespec ts;
-	unsigned long int tsus;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	tsus=ts.tv_sec*1000000 + ts.tv_nsec/1000;
+#if defined(ZYNGPIO_GPIOD)
+// GPIO character device handler => edges come with the kernel timestamp
+void zyngpio_zynswitch_handler(uint8_t i, uint8_t pin, uint8_t level, unsigned long tsus) {
+	update_zynswitch_state(i, level, tsus);
+}
+#endif
+
+#if !defined(MCP23008_INTERRUPT)
+//Update NON-ISR switches (expanded GPIO). Returns 1 if some switch changed.
+int update_expanded_zynswitches() {
+	unsigned long int tsus=zyncoder_get_tsus();
 
 	int i;
+	int active=0;
 	uint8_t status;
+	//Read all the expanded pins in a single transaction
+	int gpio=zyni2c_read_reg8(ZYNI2C_PRIO_CONTROL, MCP23008_I2C_ADDRESS, MCP23x08_GPIO);
+	if (gpio<0) return 0;
 	for (i=0;i<MAX_NUM_ZYNSWITCHES;i++) {
 		struct zynswitch_st *zynswitch = zynswitches + i;
 		if (!zynswitch->enabled || zynswitch->pin<100) continue;
-		status=digitalRead(zynswitch->pin);
+		if (zynswitch->pin>=MCP23008_BASE_PIN+8) continue;
+		status=bitRead(gpio, zynswitch->pin-MCP23008_BASE_PIN);
 		//printf("POLLING SWITCH %d (%d) => %d\n",i,zynswitch->pin,status);
-		if (status==zynswitch->status) continue;
-		zynswitch->status=status;
-		send_zynswitch_midi(zynswitch, status);
-		//printf("POLLING SWITCH %d => STATUS=%d (%lu)\n",i,zynswitch->status,tsus);
-		if (zynswitch->status==1) {
-			if (zynswitch->tsus>0) {
-				unsigned int dtus=tsus-zynswitch->tsus;
-				zynswitch->tsus=0;
-				//Ignore spurious ticks
-				if (dtus<1000) return;
-				//printf("Debounced Switch %d\n",i);
-				zynswitch->dtus=dtus;
-			}
-		} else zynswitch->tsus=tsus;
+		if (status!=zynswitch->debounce.raw) active=1;
+		update_zynswitch_state(i, status, tsus);
 	}
+	return active;
 }
 
 void * poll_zynswitches(void *arg) {
+	unsigned long int tsus, active_tsus=0;
 	while (1) {
-		update_expanded_zynswitches();
-		usleep(poll_zynswitches_us);
+		tsus=zyncoder_get_tsus();
+		if (update_expanded_zynswitches()) active_tsus=tsus;
+		//Poll fast for a while after some activity, so bounces & releases are caught soon
+		if (active_tsus>0 && tsus-active_tsus<poll_zynswitches_active_time_us) usleep(poll_zynswitches_active_us);
+		else {
+			active_tsus=0;
+			usleep(poll_zynswitches_us);
+		}
 	}
 	return NULL;
 }
@@ -410,6 +489,7 @@ pthread_t init_poll_zynswitches() {
 	}
 }
 #endif
+#endif
 
 //-----------------------------------------------------------------------------
 
@@ -425,20 +505,28 @@ struct zynswitch_st *setup_zynswitch(uint8_t i, uint8_t pin) {
 	zynswitch->tsus = 0;
 	zynswitch->dtus = 0;
 	zynswitch->status = 0;
+	zynswitch->press_tsus = 0;
+	setup_zyndebounce(&zynswitch->debounce, 0, ZYNDEBOUNCE_DEFAULT_PRESS_US, ZYNDEBOUNCE_DEFAULT_RELEASE_US);
 
 	if (pin>0) {
 		pinMode(pin, INPUT);
 		pullUpDnControl(pin, PUD_UP);
 
 #if defined(MCP23017_ENCODERS) 
-		// this is a bit brute force, but update all the banks
-		zyncoder_mcp23017_bankA_ISR();
-		zyncoder_mcp23017_bankB_ISR();
+		update_mcp23017_dispatch();
 #elif defined(MCP23008_ENCODERS)
 		if (pin<MCP23008_BASE_PIN) {
+#if defined(ZYNGPIO_GPIOD)
+			int level=setup_zyngpio_line(pin, i, zyngpio_zynswitch_handler);
+			if (level>=0) update_zynswitch_state(i, level, zyncoder_get_tsus());
+#else
 			wiringPiISR(pin,INT_EDGE_BOTH, update_zynswitch_funcs[i]);
 			update_zynswitch(i);
+#endif
 		}
+#if defined(MCP23008_INTERRUPT)
+		else update_mcp23017_dispatch();
+#endif
 #endif
 	}
 
@@ -479,9 +567,7 @@ unsigned int get_zynswitch_dtus(uint8_t i, unsigned int long_dtus) {
 		return dtus;
 	}
 	else if (zynswitches[i].tsus>0) {
-		struct timespec ts;
-		clock_gettime(CLOCK_MONOTONIC, &ts);
-		dtus=ts.tv_sec*1000000 + ts.tv_nsec/1000 - zynswitches[i].tsus;
+		dtus=zyncoder_get_tsus() - zynswitches[i].tsus;
 		if (dtus>long_dtus) {
 			zynswitches[i].tsus=0;
 			return dtus;
@@ -536,53 +622,131 @@ void send_zyncoder(uint8_t i) {
 	}
 }
 
-#ifdef MCP23008_ENCODERS
-void update_zyncoder(uint8_t i) {
-#else
-void update_zyncoder(uint8_t i, uint8_t MSB, uint8_t LSB) {
-#endif
+// Quadrature decoding: (last_state << 2 | new_state) => ticks
+// +1 => up, -1 => down, 0 => no change, ZYNCODER_QUAD_SKIP => both pins changed (a state was missed)
+const int8_t zyncoder_quadrature_table[16] = {
+	 0, -1, +1,  ZYNCODER_QUAD_SKIP,
+	+1,  0,  ZYNCODER_QUAD_SKIP, -1,
+	-1,  ZYNCODER_QUAD_SKIP,  0, +1,
+	 ZYNCODER_QUAD_SKIP, +1, -1,  0
+};
+
+//-----------------------------------------------------------------------------
+// Acceleration curves
+//-----------------------------------------------------------------------------
+
+void reset_zyncoder_accel_window(struct zyncoder_st *zyncoder, uint8_t window) {
+	int j;
+	if (window<1) window=1;
+	else if (window>ZYNCODER_MAX_ACCEL_WINDOW) window=ZYNCODER_MAX_ACCEL_WINDOW;
+	for (j=0;j<ZYNCODER_MAX_ACCEL_WINDOW;j++) zyncoder->dtus[j]=0;
+	zyncoder->dtus_sum=0;
+	zyncoder->dtus_pos=0;
+	zyncoder->accel_window=window;
+}
+
+int setup_zyncoder_accel(uint8_t i, uint8_t profile, uint8_t window, unsigned int max_ticks) {
+	if (i >= MAX_NUM_ZYNCODERS) {
+		printf("Zyncoder: Maximum number of zyncoders exceded: %d\n", MAX_NUM_ZYNCODERS);
+		return 0;
+	}
+	if (profile>=ZYNCODER_ACCEL_TABLE) {
+		printf("Zyncoder: Bad acceleration profile (%d). Use setup_zyncoder_accel_table for custom tables.\n", profile);
+		return 0;
+	}
+	struct zyncoder_st *zyncoder = zyncoders + i;
+	if (max_ticks<1) max_ticks=1;
+	else if (max_ticks>0xFFFF) max_ticks=0xFFFF;
+
+	int k;
+	double dtus, ticks;
+	for (k=0;k<ZYNCODER_ACCEL_LUT_SIZE;k++) {
+		//Bucket center
+		dtus=(k << ZYNCODER_ACCEL_LUT_SHIFT) + (1 << (ZYNCODER_ACCEL_LUT_SHIFT-1));
+		if (profile==ZYNCODER_ACCEL_EXP) {
+			if (dtus<ZYNCODER_ACCEL_EXP_DTUS) ticks=pow(max_ticks, 1.0-dtus/ZYNCODER_ACCEL_EXP_DTUS);
+			else ticks=1;
+		} else {
+			ticks=10000.0*ZYNCODER_TICKS_PER_RETENT/dtus;
+		}
+		if (ticks<1) ticks=1;
+		else if (ticks>max_ticks) ticks=max_ticks;
+		zyncoder->accel_lut[k]=(uint16_t)ticks;
+	}
+	zyncoder->accel_profile=profile;
+	reset_zyncoder_accel_window(zyncoder, window);
+	return 1;
+}
+
+// table => ZYNCODER_ACCEL_LUT_SIZE entries, ticks for every tick interval bucket (256us)
+int setup_zyncoder_accel_table(uint8_t i, uint16_t *table, uint8_t window) {
+	if (i >= MAX_NUM_ZYNCODERS) {
+		printf("Zyncoder: Maximum number of zyncoders exceded: %d\n", MAX_NUM_ZYNCODERS);
+		return 0;
+	}
+	struct zyncoder_st *zyncoder = zyncoders + i;
+	int k;
+	for (k=0;k<ZYNCODER_ACCEL_LUT_SIZE;k++) {
+		if (table[k]<1) zyncoder->accel_lut[k]=1;
+		else zyncoder->accel_lut[k]=table[k];
+	}
+	zyncoder->accel_profile=ZYNCODER_ACCEL_TABLE;
+	reset_zyncoder_accel_window(zyncoder, window);
+	return 1;
+}
+
+unsigned int get_zyncoder_errors(uint8_t i) {
+	if (i >= MAX_NUM_ZYNCODERS) return 0;
+	return zyncoders[i].errors;
+}
+
+// Update encoder with new pin states, with the time of the change
+void update_zyncoder_state(uint8_t i, uint8_t MSB, uint8_t LSB, unsigned long int tsus) {
 	if (i>=MAX_NUM_ZYNCODERS) return;
 	struct zyncoder_st *zyncoder = zyncoders + i;
 	if (zyncoder->enabled==0) return;
 
-#ifdef MCP23008_ENCODERS
-	uint8_t MSB = digitalRead(zyncoder->pin_a);
-	uint8_t LSB = digitalRead(zyncoder->pin_b);
-#endif
 	uint8_t encoded = (MSB << 1) | LSB;
 	uint8_t sum = (zyncoder->last_encoded << 2) | encoded;
-	uint8_t up=(sum == 0b1101 || sum == 0b0100 || sum == 0b0010 || sum == 0b1011);
-	uint8_t down=0;
-	if (!up) down=(sum == 0b1110 || sum == 0b0111 || sum == 0b0001 || sum == 0b1000);
+	int8_t ticks = zyncoder_quadrature_table[sum];
+	//Skipped state => 2 ticks in the last known direction
+	if (ticks == ZYNCODER_QUAD_SKIP) {
+		zyncoder->errors++;
+		ticks = 2 * zyncoder->last_dir;
+	} else if (ticks != 0) {
+		zyncoder->last_dir = ticks;
+	}
+	uint8_t up = (ticks > 0);
+	uint8_t down = (ticks < 0);
 #ifdef DEBUG
 	printf("zyncoder %2d - %08d\t%08d\t%d\t%d\n", i, int_to_int(encoded), int_to_int(sum), up, down);
 #endif
 	zyncoder->last_encoded=encoded;
+	if (ticks == 0) return;
+	if (ticks < 0) ticks = -ticks;
 
 	if (zyncoder->step==0) {
 		//Get time interval from last tick
-		struct timespec ts;
-		unsigned long int tsus;
-		clock_gettime(CLOCK_MONOTONIC, &ts);
-		tsus=ts.tv_sec*1000000 + ts.tv_nsec/1000;
 		unsigned int dtus=tsus-zyncoder->tsus;
 		//printf("ZYNCODER ISR %d => SUBVALUE=%d (%u)\n",i,zyncoder->subvalue,dtus);
 		//Ignore spurious ticks
 		if (dtus<1000) return;
 		//printf("ZYNCODER DEBOUNCED ISR %d => SUBVALUE=%d (%u)\n",i,zyncoder->subvalue,dtus);
-		//Calculate average dtus for the last ZYNCODER_TICKS_PER_RETENT ticks
-		int j;
-		unsigned int dtus_avg=dtus;
-		for (j=0;j<ZYNCODER_TICKS_PER_RETENT;j++) dtus_avg+=zyncoder->dtus[j];
-		dtus_avg/=(ZYNCODER_TICKS_PER_RETENT+1);
-		//Add last dtus to fifo array
-		for (j=0;j<ZYNCODER_TICKS_PER_RETENT-1;j++)
-			zyncoder->dtus[j]=zyncoder->dtus[j+1];
-		zyncoder->dtus[j]=dtus;
-		//Calculate step value
-		int dsval=10000*ZYNCODER_TICKS_PER_RETENT/dtus_avg;
-		if (dsval<1) dsval=1;
-		else if (dsval>2*ZYNCODER_TICKS_PER_RETENT) dsval=2*ZYNCODER_TICKS_PER_RETENT;
+		//Calculate average dtus for the last accel_window ticks
+		if (dtus>ZYNCODER_ACCEL_MAX_DTUS) {
+			//Pause => the ticks before it are forgotten, so it starts again from the slowest step
+			int k;
+			for (k=0;k<zyncoder->accel_window;k++) zyncoder->dtus[k]=ZYNCODER_ACCEL_MAX_DTUS;
+			zyncoder->dtus_sum=ZYNCODER_ACCEL_MAX_DTUS*zyncoder->accel_window;
+		} else {
+			zyncoder->dtus_sum-=zyncoder->dtus[zyncoder->dtus_pos];
+			zyncoder->dtus[zyncoder->dtus_pos]=dtus;
+			zyncoder->dtus_sum+=dtus;
+			if (++zyncoder->dtus_pos>=zyncoder->accel_window) zyncoder->dtus_pos=0;
+		}
+		unsigned int dtus_avg=zyncoder->dtus_sum/zyncoder->accel_window;
+		//Calculate step value from acceleration LUT
+		int dsval=zyncoder->accel_lut[dtus_avg>>ZYNCODER_ACCEL_LUT_SHIFT]*ticks;
 
 		int value=-1;
 		if (up) {
@@ -605,14 +769,32 @@ void update_zyncoder(uint8_t i, uint8_t MSB, uint8_t LSB) {
 	} 
 	else {
 		unsigned int last_value=zyncoder->value;
+		unsigned int dval=zyncoder->step*ticks;
 		if (zyncoder->value>zyncoder->max_value) zyncoder->value=zyncoder->max_value;
-		if (zyncoder->max_value-zyncoder->value>=zyncoder->step && up) zyncoder->value+=zyncoder->step;
-		else if (zyncoder->value>=zyncoder->step && down) zyncoder->value-=zyncoder->step;
+		if (up) {
+			if (zyncoder->max_value-zyncoder->value>=dval) zyncoder->value+=dval;
+			else if (ticks>1 && zyncoder->max_value-zyncoder->value>=zyncoder->step) zyncoder->value+=zyncoder->step;
+		}
+		else if (down) {
+			if (zyncoder->value>=dval) zyncoder->value-=dval;
+			else if (ticks>1 && zyncoder->value>=zyncoder->step) zyncoder->value-=zyncoder->step;
+		}
 		if (last_value!=zyncoder->value) send_zyncoder(i);
 	}
 
 }
 
+#ifdef MCP23008_ENCODERS
+void update_zyncoder(uint8_t i) {
+	if (i>=MAX_NUM_ZYNCODERS) return;
+	update_zyncoder_state(i, digitalRead(zyncoders[i].pin_a), digitalRead(zyncoders[i].pin_b), zyncoder_get_tsus());
+}
+#else
+void update_zyncoder(uint8_t i, uint8_t MSB, uint8_t LSB) {
+	update_zyncoder_state(i, MSB, LSB, zyncoder_get_tsus());
+}
+#endif
+
 #ifdef MCP23008_ENCODERS
 void update_zyncoder_0() { update_zyncoder(0); }
 void update_zyncoder_1() { update_zyncoder(1); }
@@ -632,6 +814,17 @@ void (*update_zyncoder_funcs[8])={
 	update_zyncoder_6,
 	update_zyncoder_7
 };
+
+#if defined(ZYNGPIO_GPIOD)
+// GPIO character device handlers => edges come with the kernel timestamp
+void zyngpio_zyncoder_handler(uint8_t i, uint8_t pin, uint8_t level, unsigned long tsus) {
+	if (i>=MAX_NUM_ZYNCODERS) return;
+	struct zyncoder_st *zyncoder = zyncoders + i;
+	if (pin==zyncoder->pin_a) zyncoder->pin_a_last_state = level;
+	else zyncoder->pin_b_last_state = level;
+	update_zyncoder_state(i, zyncoder->pin_a_last_state, zyncoder->pin_b_last_state, tsus);
+}
+#endif
 #endif
 
 //-----------------------------------------------------------------------------
@@ -666,6 +859,7 @@ struct zyncoder_st *setup_zyncoder(uint8_t i, uint8_t pin_a, uint8_t pin_b, uint
 
 	if (value>max_value) value=max_value;
 	zyncoder->step = step;
+	setup_zyncoder_accel(i, ZYNCODER_ACCEL_LINEAR, ZYNCODER_DEFAULT_ACCEL_WINDOW, ZYNCODER_DEFAULT_ACCEL_MAX);
 	if (step>0) {
 		zyncoder->value = value;
 		zyncoder->subvalue = 0;
@@ -681,6 +875,8 @@ struct zyncoder_st *setup_zyncoder(uint8_t i, uint8_t pin_a, uint8_t pin_b, uint
 		zyncoder->pin_a = pin_a;
 		zyncoder->pin_b = pin_b;
 		zyncoder->last_encoded = 0;
+		zyncoder->last_dir = 0;
+		zyncoder->errors = 0;
 		zyncoder->tsus = 0;
 
 		if (zyncoder->pin_a!=zyncoder->pin_b) {
@@ -690,12 +886,24 @@ struct zyncoder_st *setup_zyncoder(uint8_t i, uint8_t pin_a, uint8_t pin_b, uint
 			pullUpDnControl(pin_b, PUD_UP);
 
 #if defined(MCP23017_ENCODERS) 
-			// this is a bit brute force, but update all the banks
-			zyncoder_mcp23017_bankA_ISR();
-			zyncoder_mcp23017_bankB_ISR();
+			zyncoder->last_encoded = ZYNCODER_ENCODED_UNKNOWN;
+			update_mcp23017_dispatch();
 #elif defined(MCP23008_ENCODERS) 
+#if defined(ZYNGPIO_GPIOD)
+			int level_a=setup_zyngpio_line(pin_a, i, zyngpio_zyncoder_handler);
+			int level_b=setup_zyngpio_line(pin_b, i, zyngpio_zyncoder_handler);
+			if (level_a>=0 && level_b>=0) {
+				zyncoder->pin_a_last_state = level_a;
+				zyncoder->pin_b_last_state = level_b;
+				zyncoder->last_encoded = (level_a << 1) | level_b;
+			}
+#else
 			wiringPiISR(pin_a,INT_EDGE_BOTH, update_zyncoder_funcs[i]);
 			wiringPiISR(pin_b,INT_EDGE_BOTH, update_zyncoder_funcs[i]);
+			zyncoder->pin_a_last_state = digitalRead(pin_a);
+			zyncoder->pin_b_last_state = digitalRead(pin_b);
+			zyncoder->last_encoded = (zyncoder->pin_a_last_state << 1) | zyncoder->pin_b_last_state;
+#endif
 #endif
 		}
 	}
@@ -727,75 +935,157 @@ void set_value_zyncoder(uint8_t i, unsigned int v, int send) {
 }
 
 //-----------------------------------------------------------------------------
-// MCP23017 based encoders & switches
+// MCP23017 (and interrupt driven MCP23008) based encoders & switches
 //-----------------------------------------------------------------------------
 
-#ifndef MCP23008_ENCODERS 
-// ISR for handling the mcp23017 interrupts
-void zyncoder_mcp23017_ISR(struct wiringPiNodeStruct *wpns, uint16_t base_pin, uint8_t bank) {
-	// the interrupt has gone off for a pin change on the mcp23017
-	// read the appropriate bank and compare pin states to last
-	// on a change, call the update function as appropriate
+#if !defined(MCP23008_ENCODERS) || defined(MCP23008_INTERRUPT)
+struct mcp23017_st *get_mcp23017(uint16_t base_pin) {
 	int i;
-	uint8_t reg;
-	uint8_t pin_min, pin_max;
+	for (i=0;i<MAX_NUM_MCP23017;i++) {
+		if (mcp23017s[i].enabled && mcp23017s[i].base_pin==base_pin) return mcp23017s+i;
+	}
+	return NULL;
+}
 
-	#ifdef DEBUG
-	printf("MCP23017 ISR => %d, %d\n", base_pin, bank);
-	#endif
+struct mcp23017_st *register_mcp23017(uint16_t base_pin, uint8_t i2c_address, uint8_t num_pins) {
+	int i;
+	struct mcp23017_st *chip=get_mcp23017(base_pin);
+	if (chip) return chip;
+	for (i=0;i<MAX_NUM_MCP23017;i++) {
+		chip=mcp23017s+i;
+		if (chip->enabled) continue;
+		pthread_mutex_init(&chip->lock, NULL);
+		chip->i2c_address=i2c_address;
+		chip->base_pin=base_pin;
+		chip->num_pins=num_pins;
+		chip->state=0xFFFF;
+		chip->pin_mask=0;
+		memset(chip->pin_zyncoder, -1, 16);
+		memset(chip->pin_zynswitch, -1, 16);
+		chip->enabled=1;
+		return chip;
+	}
+	fprintf(stderr, "Zyncoder: Maximum number of MCP23017 exceeded: %d\n", MAX_NUM_MCP23017);
+	return NULL;
+}
 
-	if (bank == 0) {
-		reg = wiringPiI2CReadReg8(wpns->fd, MCP23x17_GPIOA);
-		//reg = wiringPiI2CReadReg8(wpns->fd, MCP23x17_INTCAPA);
-		pin_min = base_pin;
-	} else {
-		reg = wiringPiI2CReadReg8(wpns->fd, MCP23x17_GPIOB);
-		//reg = wiringPiI2CReadReg8(wpns->fd, MCP23x17_INTCAPB);
-		pin_min = base_pin + 8;
-	}
-	pin_max = pin_min + 7;
-
-	// search all encoders and switches for a pin in the bank's range
-	// if the last state != current state then this pin has changed
-	// call the update function
-	for (i=0; i<MAX_NUM_ZYNCODERS; i++) {
-		struct zyncoder_st *zyncoder = zyncoders + i;
-		if (zyncoder->enabled==0) continue;
-
-		// if either pin is in the range
-		if ((zyncoder->pin_a >= pin_min && zyncoder->pin_a <= pin_max) ||
-		    (zyncoder->pin_b >= pin_min && zyncoder->pin_b <= pin_max)) {
-			uint8_t bit_a = zyncoder->pin_a - pin_min;
-			uint8_t bit_b = zyncoder->pin_b - pin_min;
-			uint8_t state_a = bitRead(reg, bit_a);
-			uint8_t state_b = bitRead(reg, bit_b);
-			// if either bit is different
-			if ((state_a != zyncoder->pin_a_last_state) ||
+// dispatch the pins in mask to their encoder or switch handler
+void dispatch_mcp23017_pins(struct mcp23017_st *chip, uint16_t state, uint16_t mask, unsigned long int tsus) {
+	int bit;
+	int8_t i;
+	uint32_t done=0;
+	chip->state=state;
+	mask&=chip->pin_mask;
+	while (mask) {
+		bit=__builtin_ctz(mask);
+		mask&=mask-1;
+		if ((i=chip->pin_zyncoder[bit])>=0) {
+			// both encoder pins are dispatched at once
+			if (done & (1<<i)) continue;
+			done|=1<<i;
+			struct zyncoder_st *zyncoder = zyncoders + i;
+			uint8_t state_a = bitRead(state, zyncoder->pin_a - chip->base_pin);
+			uint8_t state_b = bitRead(state, zyncoder->pin_b - chip->base_pin);
+			// just set up => sync with the captured state
+			if (zyncoder->last_encoded == ZYNCODER_ENCODED_UNKNOWN) {
+				zyncoder->pin_a_last_state = state_a;
+				zyncoder->pin_b_last_state = state_b;
+				zyncoder->last_encoded = (state_a << 1) | state_b;
+			} else if ((state_a != zyncoder->pin_a_last_state) ||
 			    (state_b != zyncoder->pin_b_last_state)) {
-				// call the update function
-				update_zyncoder(i, state_a, state_b);
-				// update the last state
+				update_zyncoder_state(i, state_a, state_b, tsus);
 				zyncoder->pin_a_last_state = state_a;
 				zyncoder->pin_b_last_state = state_b;
 			}
+		} else if ((i=chip->pin_zynswitch[bit])>=0) {
+			uint8_t status = bitRead(state, bit);
+			#ifdef DEBUG
+			printf("MCP23017 Zynswitch %d => %d\n",i,status);
+			#endif
+			// compare with the raw status, so bounces are seen by the debouncer
+			if (status != zynswitches[i].debounce.raw) update_zynswitch_state(i, status, tsus);
 		}
 	}
-	for (i = 0; i < MAX_NUM_ZYNSWITCHES; ++i) {
-		struct zynswitch_st *zynswitch = zynswitches + i;
-		if (zynswitch->enabled == 0) continue;
+}
 
-		// check the pin range
-		if (zynswitch->pin >= pin_min && zynswitch->pin <= pin_max) {
-			uint8_t bit = zynswitch->pin - pin_min;
-			uint8_t state = bitRead(reg, bit);
-			#ifdef DEBUG
-			printf("MCP23017 Zynswitch %d => %d\n",i,state);
-			#endif
-			if (state != zynswitch->status) {
-				update_zynswitch(i, state);
-				// note that the update function updates status with state
+// capture both banks in a single transaction and dispatch the changes
+// mask => pins to dispatch, apart from the pins that changed
+void capture_mcp23017(struct mcp23017_st *chip, uint16_t mask) {
+	uint8_t data[6];
+	uint16_t intf, intcap, gpio;
+	unsigned long int tsus=zyncoder_get_tsus();
+	pthread_mutex_lock(&chip->lock);
+	if (chip->num_pins==8) {
+		// MCP23008 => INTF, INTCAP, GPIO (sequential)
+		if (zyni2c_read_reg(ZYNI2C_PRIO_CONTROL, chip->i2c_address, MCP23x08_INTF, data, 3)<0) {
+			pthread_mutex_unlock(&chip->lock);
+			return;
+		}
+		intf = data[0];
+		intcap = data[1];
+		gpio = data[2] | 0xFF00;
+	} else {
+		// INTFA, INTFB, INTCAPA, INTCAPB, GPIOA, GPIOB (IOCON.BANK=0, sequential)
+		if (zyni2c_read_reg(ZYNI2C_PRIO_CONTROL, chip->i2c_address, MCP23x17_INTFA, data, 6)<0) {
+			pthread_mutex_unlock(&chip->lock);
+			return;
+		}
+		intf = data[0] | (data[1] << 8);
+		intcap = data[2] | (data[3] << 8);
+		gpio = data[4] | (data[5] << 8);
+	}
+	// INTCAP keeps the state that raised the interrupt => short pulses are not lost
+	if (intf) {
+		uint16_t state = (chip->state & ~intf) | (intcap & intf);
+		dispatch_mcp23017_pins(chip, state, (state ^ chip->state) | mask, tsus);
+		mask = 0;
+	}
+	// then current state
+	dispatch_mcp23017_pins(chip, gpio, (gpio ^ chip->state) | mask, tsus);
+	pthread_mutex_unlock(&chip->lock);
+}
+
+// rebuild the pin => encoder/switch tables & refresh pin states
+void update_mcp23017_dispatch() {
+	int c, i;
+	for (c=0;c<MAX_NUM_MCP23017;c++) {
+		struct mcp23017_st *chip=mcp23017s+c;
+		if (!chip->enabled) continue;
+		pthread_mutex_lock(&chip->lock);
+		chip->pin_mask=0;
+		memset(chip->pin_zyncoder, -1, 16);
+		memset(chip->pin_zynswitch, -1, 16);
+		for (i=0; i<MAX_NUM_ZYNCODERS; i++) {
+			struct zyncoder_st *zyncoder = zyncoders + i;
+			if (zyncoder->enabled==0 || zyncoder->pin_a==zyncoder->pin_b) continue;
+			if (zyncoder->pin_a >= chip->base_pin && zyncoder->pin_a < chip->base_pin+chip->num_pins &&
+			    zyncoder->pin_b >= chip->base_pin && zyncoder->pin_b < chip->base_pin+chip->num_pins) {
+				chip->pin_zyncoder[zyncoder->pin_a - chip->base_pin] = i;
+				chip->pin_zyncoder[zyncoder->pin_b - chip->base_pin] = i;
+				chip->pin_mask |= (1 << (zyncoder->pin_a - chip->base_pin)) | (1 << (zyncoder->pin_b - chip->base_pin));
 			}
 		}
+		for (i=0; i<MAX_NUM_ZYNSWITCHES; i++) {
+			struct zynswitch_st *zynswitch = zynswitches + i;
+			if (zynswitch->enabled==0) continue;
+			if (zynswitch->pin >= chip->base_pin && zynswitch->pin < chip->base_pin+chip->num_pins) {
+				chip->pin_zynswitch[zynswitch->pin - chip->base_pin] = i;
+				chip->pin_mask |= 1 << (zynswitch->pin - chip->base_pin);
+			}
+		}
+		pthread_mutex_unlock(&chip->lock);
+		capture_mcp23017(chip, 0xFFFF);
 	}
 }
+
+// ISR for handling the mcp23017 (and mcp23008) interrupts
+void zyncoder_mcp23017_ISR(uint8_t i2c_address, uint16_t base_pin, uint8_t bank) {
+	// the interrupt has gone off for a pin change on the mcp23017
+	// both banks are captured, so it doesn't matter which one raised it
+	#ifdef DEBUG
+	printf("MCP23017 ISR => %d, %d\n", base_pin, bank);
+	#endif
+	struct mcp23017_st *chip=get_mcp23017(base_pin);
+	if (chip) capture_mcp23017(chip, 0);
+}
 #endif
@@ -28,6 +28,10 @@
 #include <lo/lo.h>
 
 #include "zynmidirouter.h"
+#include "zynccmap.h"
+#include "zyni2c.h"
+#include "zyngpio.h"
+#include "zynswitch.h"
 #include "zynmaster.h"
 #include "zynaptik.h"
 #include "zyntof.h"
@@ -42,10 +46,42 @@ int end_zynlib();
 int init_zyncoder();
 int end_zyncoder();
 
+//-----------------------------------------------------------------------------
+// Time source
+//-----------------------------------------------------------------------------
+
+// Time source (us) for encoder & switch timing => NULL for CLOCK_MONOTONIC.
+// With a custom clock, debounce settle times are run by zyndebounce_run().
+typedef unsigned long (*zyncoder_clock_t)(void);
+void set_zyncoder_clock(zyncoder_clock_t clock);
+unsigned long zyncoder_get_tsus();
+
 struct wiringPiNodeStruct * init_mcp23017(int base_pin, uint8_t i2c_address, uint8_t inta_pin, uint8_t intb_pin, void (*isrs[2]));
 
 // generic auxiliar ISR routine for zyncoders
-void zyncoder_mcp23017_ISR(struct wiringPiNodeStruct *wpns, uint16_t base_pin, uint8_t bank);
+void zyncoder_mcp23017_ISR(uint8_t i2c_address, uint16_t base_pin, uint8_t bank);
+
+//-----------------------------------------------------------------------------
+// MCP23017 pin dispatch (also used by the MCP23008 when its INT pin is wired)
+//-----------------------------------------------------------------------------
+
+#define MAX_NUM_MCP23017 2
+
+struct mcp23017_st {
+	uint8_t enabled;
+	uint8_t i2c_address;
+	uint16_t base_pin;
+	uint8_t num_pins;			// 16 for MCP23017, 8 for MCP23008
+	pthread_mutex_t lock;
+	uint16_t state;				// last dispatched pin states (bank B => high byte)
+	uint16_t pin_mask;			// pins assigned to an encoder or switch
+	int8_t pin_zyncoder[16];	// pin => zyncoder index, -1 if none
+	int8_t pin_zynswitch[16];	// pin => zynswitch index, -1 if none
+};
+struct mcp23017_st mcp23017s[MAX_NUM_MCP23017];
+
+// rebuild the dispatch tables after setting up encoders or switches
+void update_mcp23017_dispatch();
 
 //-----------------------------------------------------------------------------
 // GPIO Switches
@@ -61,6 +97,10 @@ struct zynswitch_st {
 	// note that this status is like the pin_[ab]_last_state for the 
 	// zyncoders
 	volatile uint8_t status;
+	// raw status & settle times
+	struct zyndebounce_st debounce;
+	// time of the last press, for the events queue
+	unsigned long press_tsus;
 
 	struct midi_event_st midi_event;
 	int last_cvgate_note;
@@ -69,6 +109,7 @@ struct zynswitch_st zynswitches[MAX_NUM_ZYNSWITCHES];
 
 struct zynswitch_st *setup_zynswitch(uint8_t i, uint8_t pin); 
 int setup_zynswitch_midi(uint8_t i, enum midi_event_type_enum midi_evt, uint8_t midi_chan, uint8_t midi_num, uint8_t midi_val);
+int setup_zynswitch_debounce(uint8_t i, unsigned int press_us, unsigned int release_us);
 unsigned int get_zynswitch(uint8_t i, unsigned int long_dtus);
 unsigned int get_zynswitch_dtus(uint8_t i, unsigned int long_dtus);
 
@@ -81,6 +122,29 @@ unsigned int get_zynswitch_dtus(uint8_t i, unsigned int long_dtus);
 // Number of ticks per retent in rotary encoders
 #define ZYNCODER_TICKS_PER_RETENT 4
 
+// Quadrature table mark for illegal transitions (skipped state)
+#define ZYNCODER_QUAD_SKIP 2
+
+// Pin states not known yet => synced with the first capture, without decoding a step
+#define ZYNCODER_ENCODED_UNKNOWN 0xFF
+
+// Acceleration profiles (only for step=0 encoders)
+#define ZYNCODER_ACCEL_LINEAR 0		// ticks proportional to speed (default)
+#define ZYNCODER_ACCEL_EXP 1			// ticks grow exponentially with speed
+#define ZYNCODER_ACCEL_TABLE 2		// user table
+
+// Acceleration LUT => indexed by the averaged tick interval, in 256us buckets
+#define ZYNCODER_ACCEL_LUT_SHIFT 8
+#define ZYNCODER_ACCEL_LUT_SIZE 256
+#define ZYNCODER_ACCEL_MAX_DTUS ((ZYNCODER_ACCEL_LUT_SIZE << ZYNCODER_ACCEL_LUT_SHIFT) - 1)
+// Slowest tick interval accelerated by the exponential profile
+#define ZYNCODER_ACCEL_EXP_DTUS 40000
+
+// Averaging window (tick intervals) & max ticks per step
+#define ZYNCODER_MAX_ACCEL_WINDOW 16
+#define ZYNCODER_DEFAULT_ACCEL_WINDOW (ZYNCODER_TICKS_PER_RETENT+1)
+#define ZYNCODER_DEFAULT_ACCEL_MAX (2*ZYNCODER_TICKS_PER_RETENT)
+
 struct zyncoder_st {
 	uint8_t enabled;
 	uint8_t pin_a;
@@ -97,8 +161,15 @@ struct zyncoder_st {
 	volatile unsigned int subvalue;
 	volatile unsigned int value;
 	volatile unsigned int last_encoded;
+	volatile int8_t last_dir;			// last decoded direction (+1/-1), 0 if unknown
+	volatile unsigned int errors;		// illegal transitions count (health metric)
 	volatile unsigned long tsus;
-	unsigned int dtus[ZYNCODER_TICKS_PER_RETENT];
+	unsigned int dtus[ZYNCODER_MAX_ACCEL_WINDOW];
+	unsigned int dtus_sum;
+	uint8_t dtus_pos;
+	uint8_t accel_profile;
+	uint8_t accel_window;
+	uint16_t accel_lut[ZYNCODER_ACCEL_LUT_SIZE];
 };
 struct zyncoder_st zyncoders[MAX_NUM_ZYNCODERS];
 
@@ -107,4 +178,9 @@ void midi_event_zyncoders(uint8_t midi_chan, uint8_t midi_ctrl, uint8_t val);
 struct zyncoder_st *setup_zyncoder(uint8_t i, uint8_t pin_a, uint8_t pin_b, uint8_t midi_chan, uint8_t midi_ctrl, char *osc_path, unsigned int value, unsigned int max_value, unsigned int step); 
 unsigned int get_value_zyncoder(uint8_t i);
 void set_value_zyncoder(uint8_t i, unsigned int v, int send);
+unsigned int get_zyncoder_errors(uint8_t i);
+
+// Acceleration curve => reset to default by setup_zyncoder, so call it after
+int setup_zyncoder_accel(uint8_t i, uint8_t profile, uint8_t window, unsigned int max_ticks);
+int setup_zyncoder_accel_table(uint8_t i, uint16_t *table, uint8_t window);
 
@@ -42,6 +42,10 @@ def lib_zyncoder_init():
 		lib_zyncoder.init_zynlib()
 		#Setup return type for some functions
 		lib_zyncoder.get_midi_filter_clone_cc.restype = ndpointer(dtype=c_ubyte, shape=(128,))
+		lib_zyncoder.get_midi_filter_cc_lut.restype = ndpointer(dtype=c_ubyte, shape=(128,))
+		lib_zyncoder.get_midi_filter_event_fanout_lut.restype = ndpointer(dtype=c_ubyte, shape=(128,))
+		lib_zyncoder.set_midi_filter_cc_curve.argtypes = [c_ubyte, c_ubyte, c_ubyte, c_ubyte, c_float]
+		lib_zyncoder.zmip_get_velocity_lut.restype = ndpointer(dtype=c_ubyte, shape=(128,))
 
 	except Exception as e:
 		lib_zyncoder=None
@@ -33,11 +33,18 @@
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "zyncoder_i2c.h"
 #include "zynmidirouter.h"
+#include "zynccmap.h"
+#include "zyni2c.h"
 
-#include <wiringPi.h>
+#if defined(HAVE_WIRINGPI_LIB)
+	#include <wiringPi.h>
+#else
+	#include "wiringPiEmu.h"
+#endif
 
 #define DEBUG
 
@@ -52,6 +59,8 @@
 
 /** Initialise zyncoder library */
 int init_zynlib() {
+	init_zynccmaps();
+	if (!init_zyni2c()) return 0;
 	if (!init_zyncoder()) return 0;
 	if (!init_zynmidirouter()) return 0;
 	return 1;
@@ -61,6 +70,7 @@ int init_zynlib() {
 int end_zynlib() {
 	if (!end_zynmidirouter()) return 0;
 	if (!end_zyncoder()) return 0;
+	if (!end_zyni2c()) return 0;
 	return 1;
 }
 
@@ -80,9 +90,15 @@ int init_zyncoder() {
 	for (i=0;i<MAX_NUM_ZYNCODERS;i++) {
 		zyncoders[i].enabled=0;
 	}
+	for (i=0;i<MAX_NUM_ZYNPOTS;i++) {
+		zynpots[i].enabled=0;
+	}
+	for (i=0;i<256;i++) {
+		hwc_ctrls[i].type=HWC_CTRL_NONE;
+	}
 	wiringPiSetup();
-	hwci2c_fd = wiringPiI2CSetup(HWC_ADDR);
-	wiringPiI2CWriteReg8(hwci2c_fd, 0, 0); // Reset HWC
+	init_zyndebounce(zynswitches_debounce_expire);
+	zyni2c_write_reg8(ZYNI2C_PRIO_CONTROL, HWC_ADDR, 0, 0); // Reset HWC
 	wiringPiISR(INTERRUPT_PIN, INT_EDGE_FALLING, handleRibanHwc);
 	return 1;
 }
@@ -91,25 +107,44 @@ int init_zyncoder() {
 *   @retval int 1 on success, 0 on fail
 */
 int end_zyncoder() {
+	end_zyndebounce();
 	return 1;
 }
 
 //-----------------------------------------------------------------------------
-// GPIO Switches
+// Time source
 //-----------------------------------------------------------------------------
 
-/** @brief  Update the status (value) of a switch
-*   @param  i Index of switch to update
-*   @param  status New status (value) of switch
-*   @note   Triggers any configured switch events. Does nothing if switch disabled or status not changed.
-*   @note   Updates switch close time / switch release duration.
+zyncoder_clock_t zyncoder_clock=NULL;
+
+/** @brief  Set the time source for switch timing
+*   @param  clock Function returning the time in us (NULL for CLOCK_MONOTONIC)
 */
-void update_zynswitch(uint8_t i, uint8_t status) {
-	struct zynswitch_st *zynswitch = zynswitches + i;
-	if (zynswitch->enabled==0) return;
-	if (status==zynswitch->status) return;
-	zynswitch->status=status;
+void set_zyncoder_clock(zyncoder_clock_t clock) {
+	zyncoder_clock=clock;
+	set_zyndebounce_clock(clock);
+}
 
+/** @brief  Get the current time from the time source
+*   @retval unsigned long Time in us
+*/
+unsigned long zyncoder_get_tsus() {
+	if (zyncoder_clock) return zyncoder_clock();
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+//-----------------------------------------------------------------------------
+// GPIO Switches
+//-----------------------------------------------------------------------------
+
+/** @brief  Send the MIDI event assigned to a switch
+*   @param  zynswitch Pointer to the switch structure
+*   @param  status Debounced switch status
+*   @note   Called from process_zynswitch_status (zynswitch.c) when the status changes.
+*/
+void send_zynswitch_midi(struct zynswitch_st *zynswitch, uint8_t status) {
 	if (zynswitch->midi_cc>0) {
 		uint8_t val=0;
 		if (status==0) val=127;
@@ -120,21 +155,15 @@ void update_zynswitch(uint8_t i, uint8_t status) {
 		//Send MIDI event to UI
 		write_zynmidi_ccontrol_change(zynswitch->midi_chan, zynswitch->midi_cc, val);
 	}
+}
 
-	struct timespec ts;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	unsigned long int tsus=ts.tv_sec*1000000 + ts.tv_nsec/1000;
-
-    // Switch active 0 - detect switch press and set press time (tsus) or detect release and set press duration (dtus)
-	if (zynswitch->status==1) {
-        // Switch released
-		if (zynswitch->tsus>0) {
-			unsigned int dtus=tsus-zynswitch->tsus;
-			zynswitch->tsus=0;
-			if (dtus<1000) return;
-			zynswitch->dtus=dtus;
-		}
-	} else zynswitch->tsus=tsus;
+/** @brief  Update the status (value) of a switch
+*   @param  i Index of switch to update
+*   @param  status New status (value) of switch
+*   @note   Goes through the debounce state machine. Does nothing if switch disabled.
+*/
+void update_zynswitch(uint8_t i, uint8_t status) {
+	update_zynswitch_state(i, status, zyncoder_get_tsus());
 }
 
 //-----------------------------------------------------------------------------
@@ -152,9 +181,12 @@ struct zynswitch_st *setup_zynswitch(uint8_t i, uint8_t index) {
 	struct zynswitch_st *zynswitch = zynswitches + i;
 	zynswitch->enabled = 1;
 	zynswitch->index = index + 64; // First switch is at I2C register 64
+	set_hwc_ctrl(zynswitch->index, HWC_CTRL_ZYNSWITCH, i);
 	zynswitch->tsus = 0;
 	zynswitch->dtus = 0;
 	zynswitch->status = 1; // Switches are active low
+	zynswitch->press_tsus = 0;
+	setup_zyndebounce(&zynswitch->debounce, 1, ZYNDEBOUNCE_DEFAULT_PRESS_US, ZYNDEBOUNCE_DEFAULT_RELEASE_US);
     return zynswitch;
 }
 
@@ -191,9 +223,7 @@ unsigned int get_zynswitch_dtus(uint8_t i, unsigned int long_dtus) {
 		return dtus;
 	}
 	else if (zynswitches[i].tsus>0) {
-		struct timespec ts;
-		clock_gettime(CLOCK_MONOTONIC, &ts);
-		dtus=ts.tv_sec*1000000 + ts.tv_nsec/1000 - zynswitches[i].tsus;
+		dtus=zyncoder_get_tsus() - zynswitches[i].tsus;
 		if (dtus>long_dtus) {
 			zynswitches[i].tsus=0;
 			return dtus;
@@ -291,6 +321,7 @@ struct zyncoder_st *setup_zyncoder(uint8_t i, uint8_t pin_a, uint8_t pin_b, uint
 	zyncoder->midi_chan = midi_chan;
 	zyncoder->midi_ctrl = midi_ctrl;
 	zyncoder->index = pin_a + 114; // I2C encoders start at register 115
+	set_hwc_ctrl(zyncoder->index, HWC_CTRL_ZYNCODER, i);
 	zyncoder->step = step;
 
 	if (osc_path) {
@@ -338,29 +369,87 @@ void set_value_zyncoder(uint8_t i, unsigned int v, int send) {
 	if (send) send_zyncoder(i);
 }
 
-#include <wiringPiI2C.h>
-/** Called when an interrupt signal detected from riban HWC.
-    Interrupt indicates a change has occured on HWC hence there is data to read.
-    Must read one byte from HWC register 0 to detect the control that has changed then read that control's value.
-    (Controller index starts at 1. '0' means there are no changes since last read.)
-    Control value may be absolute (e.g. potentiometer or switch) or relative from last read (e.g. rotary encoder).
-    Interrupt remains asserted until all changed values are read.
-    We use zyncoder_st::pin_a to hold HWC enoder index.
-    We use zynswitch_st::pin to hold HWC switch index.
+//-----------------------------------------------------------------------------
+// Potentiometers
+//-----------------------------------------------------------------------------
+
+/** @brief  Configure a potentiometer
+*   @param  i Index of potentiometer
+*   @param  index Physical HWC control index
+*   @param  midi_evt MIDI event type (CTRL_CHANGE, PITCH_BENDING, CHAN_PRESS)
+*   @param  midi_chan MIDI channel
+*   @param  midi_num MIDI controller number
+*   @retval int 1 on success, 0 on fail
+*   @note   Range, curve, deadband, smoothing & rate limit are configured on zynccmap ZYNCCMAP_POT0+i. Smoothing is off by default.
 */
-/** @brief  Handle I2C hardware controller interrupt signal
-*   @note   Reads all changed controls, updates switches and encoders and triggers events
+int setup_zynpot(uint8_t i, uint8_t index, int midi_evt, uint8_t midi_chan, uint8_t midi_num) {
+	if (i >= MAX_NUM_ZYNPOTS) {
+		fprintf(stderr, "Zyncoder: Maximum number of potentiometers exceeded: %d\n", MAX_NUM_ZYNPOTS);
+		return 0;
+	}
+	struct zynpot_st *zynpot = zynpots + i;
+	zynpot->enabled = 0;
+	zynpot->index = index;
+	zynpot->value = 0;
+	set_hwc_ctrl(zynpot->index, HWC_CTRL_ZYNPOT, i);
+	if (!setup_zynccmap(ZYNCCMAP_POT0 + i, midi_evt, midi_chan, midi_num)) return 0;
+	set_zynccmap_range(ZYNCCMAP_POT0 + i, 0, ZYNPOT_MAX_VALUE);
+	//The HWC only sends changed values => a moving average would stop short of the last one
+	set_zynccmap_smooth(ZYNCCMAP_POT0 + i, 0);
+	zynpot->enabled = 1;
+	return 1;
+}
+
+/** @brief  Disable a potentiometer
+*   @param  i Index of potentiometer
 */
-void handleRibanHwc() {
-    //loop until all HWC changes are read
-    int i;
-    uint8_t reg;
-    while(reg = wiringPiI2CRead(hwci2c_fd)) {
-        int16_t nValue = wiringPiI2CReadReg16(hwci2c_fd, reg);
-        for(i=0; i<MAX_NUM_ZYNCODERS; i++) {
+void disable_zynpot(uint8_t i) {
+	if (i >= MAX_NUM_ZYNPOTS) return;
+	zynpots[i].enabled = 0;
+	disable_zynccmap(ZYNCCMAP_POT0 + i);
+}
+
+/** @brief  Get last raw value of a potentiometer
+*   @param  i Index of potentiometer
+*   @retval unsigned int Raw value read from HWC
+*/
+unsigned int get_value_zynpot(uint8_t i) {
+	if (i >= MAX_NUM_ZYNPOTS) return 0;
+	return zynpots[i].value;
+}
+
+//-----------------------------------------------------------------------------
+// I2C Hardware Controller
+//-----------------------------------------------------------------------------
+
+/** @brief  Set the control mapped to a HWC register
+*   @param  reg HWC register
+*   @param  type Control type (HWC_CTRL_*)
+*   @param  i Index of control
+*   @note   A register mapped to other control of the same type is released
+*/
+void set_hwc_ctrl(uint8_t reg, uint8_t type, uint8_t i) {
+	int r;
+	for (r=0; r<256; r++) {
+		if (hwc_ctrls[r].type == type && hwc_ctrls[r].i == i)
+			hwc_ctrls[r].type = HWC_CTRL_NONE;
+	}
+	hwc_ctrls[reg].i = i;
+	hwc_ctrls[reg].type = type;
+}
+
+/** @brief  Dispatch a HWC control value
+*   @param  reg HWC register of changed control
+*   @param  nValue Control value (absolute or relative)
+*/
+void dispatch_hwc_ctrl(uint8_t reg, int16_t nValue) {
+    struct hwc_ctrl_st *ctrl = hwc_ctrls + reg;
+    uint8_t i = ctrl->i;
+    switch (ctrl->type) {
+        case HWC_CTRL_ZYNCODER: {
             struct zyncoder_st *zyncoder = zyncoders + i;
-            if(zyncoder->enabled==0 || zyncoder->index != reg)
-                continue;
+            if(zyncoder->enabled == 0)
+                break;
             if(zyncoder->step)
                 nValue *= ZYNCODER_TICKS_PER_RETENT * zyncoder->step;
             nValue += zyncoder->value;
@@ -372,12 +461,66 @@ void handleRibanHwc() {
             send_zyncoder(i);
             break;
         }
-        for(i=0; i<MAX_NUM_ZYNSWITCHES; i++) {
-            struct zynswitch_st *zynswitch = zynswitches + i;
-            if(zynswitch->enabled == 0 || zynswitch->index != reg)
-                continue;
+        case HWC_CTRL_ZYNSWITCH:
             update_zynswitch(i, nValue?0:1); // Have to invert switch value because zyncoder uses active low switch values
             break;
+        case HWC_CTRL_ZYNPOT: {
+            struct zynpot_st *zynpot = zynpots + i;
+            if(zynpot->enabled == 0)
+                break;
+            zynpot->value = (uint16_t)nValue;
+            zynccmap_input(ZYNCCMAP_POT0 + i, zynpot->value);
+            break;
+        }
+    }
+}
+
+/** Called when an interrupt signal detected from riban HWC.
+    Interrupt indicates a change has occured on HWC hence there is data to read.
+    Must read one byte from HWC register 0 to detect the control that has changed then read that control's value.
+    (Controller index starts at 1. '0' means there are no changes since last read.)
+    Control value may be absolute (e.g. potentiometer or switch) or relative from last read (e.g. rotary encoder).
+    Interrupt remains asserted until all changed values are read.
+    With HWC_BULK_READ, the changed controls & values are read in block reads from register HWC_REG_BULK instead.
+    Changed controls are dispatched through the register => control table (hwc_ctrls).
+    We use zyncoder_st::pin_a to hold HWC enoder index.
+    We use zynswitch_st::pin to hold HWC switch index.
+*/
+/** @brief  Handle I2C hardware controller interrupt signal
+*   @note   Reads all changed controls, updates switches and encoders and triggers events
+*/
+void handleRibanHwc() {
+#if defined(HWC_BULK_READ)
+    //read the dirty list & values in block reads, until all HWC changes are read (up to HWC_BULK_MAX_READS)
+    int i, n = 0;
+    uint8_t data[1 + 3 * HWC_BULK_MAX_ENTRIES];
+    uint8_t count;
+    do {
+        if(zyni2c_read_reg(ZYNI2C_PRIO_CONTROL, HWC_ADDR, HWC_REG_BULK, data, sizeof(data)) < 0)
+            break;
+        count = data[0] & ~HWC_BULK_MORE;
+        if(count > HWC_BULK_MAX_ENTRIES)
+            count = HWC_BULK_MAX_ENTRIES;
+        for(i=0; i<count; i++) {
+            uint8_t *entry = data + 1 + 3 * i;
+            dispatch_hwc_ctrl(entry[0], entry[1] | (entry[2] << 8)); // HWC values are little-endian
         }
+        //No entries but more pending => bad readout, don't spin on it
+        if(count == 0)
+            break;
+    } while((data[0] & HWC_BULK_MORE) && ++n < HWC_BULK_MAX_READS);
+    if(n >= HWC_BULK_MAX_READS)
+        fprintf(stderr, "Zyncoder: HWC bulk readout stopped after %d reads with changes pending.\n", n);
+#else
+    //loop until all HWC changes are read
+    int val;
+    uint8_t reg;
+    uint8_t data[2];
+    while((val = zyni2c_read_byte(ZYNI2C_PRIO_CONTROL, HWC_ADDR)) > 0) {
+        reg = val;
+        if(zyni2c_read_reg(ZYNI2C_PRIO_CONTROL, HWC_ADDR, reg, data, 2) < 0)
+            break;
+        dispatch_hwc_ctrl(reg, data[0] | (data[1] << 8)); // HWC values are little-endian (SMBus word)
     }
+#endif
 }
@@ -27,6 +27,8 @@
 
 #include <lo/lo.h>
 
+#include "zynswitch.h"
+
 //-----------------------------------------------------------------------------
 // Library Initialization
 //-----------------------------------------------------------------------------
@@ -37,6 +39,16 @@ int end_zynlib();
 int init_zyncoder();
 int end_zyncoder();
 
+//-----------------------------------------------------------------------------
+// Time source
+//-----------------------------------------------------------------------------
+
+// Time source (us) for switch timing => NULL for CLOCK_MONOTONIC.
+// With a custom clock, debounce settle times are run by zyndebounce_run().
+typedef unsigned long (*zyncoder_clock_t)(void);
+void set_zyncoder_clock(zyncoder_clock_t clock);
+unsigned long zyncoder_get_tsus();
+
 //-----------------------------------------------------------------------------
 // GPIO Switches
 //-----------------------------------------------------------------------------
@@ -51,6 +63,8 @@ struct zynswitch_st {
 	volatile unsigned long tsus; // timestamp of switch close
 	volatile unsigned int dtus; // duration of switch press after switch open
 	volatile uint8_t status; // 0 if switch closed, 1 if switch open
+	struct zyndebounce_st debounce; // raw status & settle times
+	unsigned long press_tsus; // time of the last press, for the events queue
 
 	uint8_t midi_chan; // MIDI channel assigned to custom switch event
 	uint8_t midi_cc; // MIDI control change assigned to custom switch event
@@ -58,9 +72,9 @@ struct zynswitch_st {
 struct zynswitch_st zynswitches[MAX_NUM_ZYNSWITCHES];
 
 struct zynswitch_st *setup_zynswitch(uint8_t i, uint8_t pin);
+int setup_zynswitch_debounce(uint8_t i, unsigned int press_us, unsigned int release_us);
 unsigned int get_zynswitch(uint8_t i, unsigned int long_dtus);
 unsigned int get_zynswitch_dtus(uint8_t i, unsigned int long_dtus);
-int hwci2c_fd; // File descriptor for I2C interface to hardware controller
 
 //-----------------------------------------------------------------------------
 // Rotary Encoders
@@ -91,4 +105,50 @@ struct zyncoder_st *setup_zyncoder(uint8_t i, uint8_t pin_a, uint8_t pin_b, uint
 unsigned int get_value_zyncoder(uint8_t i);
 void set_value_zyncoder(uint8_t i, unsigned int v, int send);
 
+//-----------------------------------------------------------------------------
+// Potentiometers
+//-----------------------------------------------------------------------------
+
+// Maximum 16 I2C potentiometers => mapped to MIDI by zynccmap
+#define MAX_NUM_ZYNPOTS 16
+// Default HWC potentiometer range (10 bits ADC)
+#define ZYNPOT_MAX_VALUE 1023
+
+struct zynpot_st {
+	uint8_t enabled; // 1 if potentiometer enabled
+	uint8_t index; // physical control index mapped to this logical potentiometer
+	volatile uint16_t value; // last value read from HWC
+};
+struct zynpot_st zynpots[MAX_NUM_ZYNPOTS];
+
+int setup_zynpot(uint8_t i, uint8_t index, int midi_evt, uint8_t midi_chan, uint8_t midi_num);
+void disable_zynpot(uint8_t i);
+unsigned int get_value_zynpot(uint8_t i);
+
+//-----------------------------------------------------------------------------
+// I2C Hardware Controller
+//-----------------------------------------------------------------------------
+
+// Bulk readout register => [count, (reg, value LSB, value MSB) x count] in one block read.
+// Bit 7 of count is set if there are more changes pending.
+#define HWC_REG_BULK 0xF0
+#define HWC_BULK_MORE 0x80
+#define HWC_BULK_MAX_ENTRIES 10
+// Maximum block reads per interrupt => a device stuck with the "more" bit set can't hog the bus
+#define HWC_BULK_MAX_READS 16
+
+// HWC register => control table
+#define HWC_CTRL_NONE 0
+#define HWC_CTRL_ZYNCODER 1
+#define HWC_CTRL_ZYNSWITCH 2
+#define HWC_CTRL_ZYNPOT 3
+
+struct hwc_ctrl_st {
+	uint8_t type;
+	uint8_t i;
+};
+struct hwc_ctrl_st hwc_ctrls[256];
+
+void set_hwc_ctrl(uint8_t reg, uint8_t type, uint8_t i);
+
 void handleRibanHwc();
@@ -0,0 +1,213 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Zyncoder Scenario Runner
+ *
+ * Replays edge traces against the wiringPi emulator with virtual
+ * time, so encoder acceleration, debounce & long-press behavior are
+ * reproducible. Reports the resulting state, the input path
+ * processing time and the emulated I2C bus usage.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "zyncoder.h"
+#include "wiringPiEmu.h"
+#include "zyni2cemu.h"
+
+//-----------------------------------------------------------------------------
+// Trace format (one command per line, '#' for comments):
+//
+//   switch <i> <pin>
+//   encoder <i> <pin_a> <pin_b> <value> <max_value> <step>
+//   <tsus> <pin> <value>        => edge at virtual time tsus
+//   end <tsus>                  => advance virtual time (settle times, long press)
+//
+// Without a trace file, a synthetic scenario is run (encoder spins & switch taps).
+// With interrupt driven expanders, it's run on the expander pins (REPLAY_BASE_PIN).
+//-----------------------------------------------------------------------------
+
+#if defined(MCP23017_ENCODERS) || (defined(MCP23008_ENCODERS) && defined(MCP23008_INT_PIN))
+	#define REPLAY_BASE_PIN 100
+#else
+	#define REPLAY_BASE_PIN 0
+#endif
+
+struct wpiemu_shm_st *replay_shm;
+volatile unsigned long replay_tsus=0;
+unsigned long replay_edges=0;
+double replay_wall_us=0;
+int replay_verbose=0;
+unsigned int replay_presses=0;
+unsigned int replay_releases=0;
+
+// Virtual clock => time of the edge being dispatched, or the last trace time
+unsigned long replay_clock() {
+	uint64_t tsus=wiringPiEmuEdgeTsus();
+	if (tsus) return tsus;
+	return replay_tsus;
+}
+
+double replay_get_wall_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000.0 + ts.tv_nsec/1000.0;
+}
+
+// Read the switch events => printed in verbose mode
+void replay_events() {
+	struct zynswitch_event_st events[16];
+	int i, n;
+	while ((n=get_zynswitch_events(events, 16))>0) {
+		for (i=0;i<n;i++) {
+			if (events[i].status) replay_releases++;
+			else replay_presses++;
+			if (!replay_verbose) continue;
+			printf("SWITCH %d => %s at %lu", events[i].i, events[i].status ? "release" : "press", events[i].tsus);
+			if (events[i].status) printf(" (%u us)", events[i].dtus);
+			printf("\n");
+		}
+	}
+}
+
+// Advance the virtual time, running the settle times that end before tsus
+void replay_advance(unsigned long tsus) {
+	replay_tsus=tsus;
+	zyndebounce_run(tsus);
+	replay_events();
+}
+
+// Inject an edge & wait until it's processed, so the replay is deterministic
+void replay_edge(unsigned long tsus, uint16_t pin, uint16_t value) {
+	replay_advance(tsus);
+	double t0=replay_get_wall_us();
+	while (!wpiemu_push_edge(replay_shm, pin, value, tsus)) sched_yield();
+	wpiemu_notify(replay_shm);
+	while (__atomic_load_n(&replay_shm->tail, __ATOMIC_ACQUIRE)!=__atomic_load_n(&replay_shm->head, __ATOMIC_ACQUIRE)) sched_yield();
+	replay_wall_us+=replay_get_wall_us()-t0;
+	replay_edges++;
+	replay_events();
+}
+
+int replay_file(const char *fpath) {
+	FILE *f=fopen(fpath, "r");
+	if (!f) {
+		fprintf(stderr, "ZyncoderReplay: Can't open trace file %s\n", fpath);
+		return 0;
+	}
+	char line[256];
+	int n=0;
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		unsigned int i, pin_a, pin_b, value, max_value, step;
+		unsigned long tsus;
+		char *p=line;
+		while (*p==' ' || *p=='\t') p++;
+		if (*p=='#' || *p=='\n' || *p==0) continue;
+		if (sscanf(p, "switch %u %u", &i, &pin_a)==2) {
+			setup_zynswitch(i, pin_a);
+		} else if (sscanf(p, "encoder %u %u %u %u %u %u", &i, &pin_a, &pin_b, &value, &max_value, &step)==6) {
+			setup_zyncoder(i, pin_a, pin_b, 0, 0, NULL, value, max_value, step);
+		} else if (sscanf(p, "end %lu", &tsus)==1) {
+			replay_advance(tsus);
+		} else if (sscanf(p, "%lu %u %u", &tsus, &pin_a, &value)==3) {
+			replay_edge(tsus, pin_a, value);
+		} else {
+			fprintf(stderr, "ZyncoderReplay: Bad command at line %d => %s", n, line);
+		}
+	}
+	fclose(f);
+	return 1;
+}
+
+// Encoder 0 on pins 4,5 & switch 0 on pin 1 (from REPLAY_BASE_PIN) => spins at increasing speed & taps
+void replay_synthetic() {
+	const uint8_t gray[4]={0x3, 0x1, 0x0, 0x2};
+	const uint16_t pin_sw=REPLAY_BASE_PIN+1, pin_a=REPLAY_BASE_PIN+4, pin_b=REPLAY_BASE_PIN+5;
+	unsigned long tsus=1000000;
+	int i, j, k;
+	setup_zynswitch(0, pin_sw);
+	setup_zyncoder(0, pin_a, pin_b, 0, 0, NULL, 0, 1000000, 0);
+	for (k=0;k<100;k++) {
+		//One detent per 20ms down to 1ms
+		unsigned long dtus=20000 - 190*k;
+		for (j=0;j<1000;j++) {
+			for (i=1;i<=ZYNCODER_TICKS_PER_RETENT;i++) {
+				uint8_t state=gray[i % 4];
+				uint8_t last=gray[(i-1) % 4];
+				tsus+=dtus/ZYNCODER_TICKS_PER_RETENT;
+				if ((state ^ last) & 0x2) replay_edge(tsus, pin_a, state >> 1);
+				else replay_edge(tsus, pin_b, state & 0x1);
+			}
+		}
+		//Bouncy tap
+		replay_edge(tsus+=1000, pin_sw, 0);
+		replay_edge(tsus+=200, pin_sw, 1);
+		replay_edge(tsus+=200, pin_sw, 0);
+		replay_edge(tsus+=50000, pin_sw, 1);
+		replay_edge(tsus+=300, pin_sw, 0);
+		replay_edge(tsus+=300, pin_sw, 1);
+		replay_advance(tsus+=20000);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int i;
+
+	set_zyncoder_clock(replay_clock);
+	set_zyni2cemu_clock(replay_clock);
+	if (!init_zyni2c()) return 1;
+	if (!init_zyncoder()) return 1;
+	replay_shm=wpiemu_attach();
+	if (!replay_shm) {
+		fprintf(stderr, "ZyncoderReplay: Can't attach to the wiringPi emulator\n");
+		return 1;
+	}
+
+	if (argc>1) {
+		replay_verbose=1;
+		if (!replay_file(argv[1])) return 1;
+	} else {
+		replay_synthetic();
+	}
+
+	printf("ZYNCODERS:\n");
+	for (i=0;i<MAX_NUM_ZYNCODERS;i++) {
+		if (!zyncoders[i].enabled) continue;
+		printf("  %d => value=%u, errors=%u\n", i, get_value_zyncoder(i), get_zyncoder_errors(i));
+	}
+	printf("ZYNSWITCHES: %u presses, %u releases, %u events lost\n", replay_presses, replay_releases, get_zynswitch_events_lost());
+	printf("EDGES: %lu in %.0f us => %.3f us/edge\n", replay_edges, replay_wall_us, replay_edges ? replay_wall_us/replay_edges : 0);
+	struct zyni2cemu_stats_st *bus=&zyni2cemu_bus_stats;
+	printf("I2C: %lu transactions, %lu bytes read, %lu bytes written, %lu us of bus time, %lu NACKs",
+		bus->xfers, bus->bytes_read, bus->bytes_written, bus->bus_us, zyni2cemu_nacks);
+	if (replay_edges) printf(" => %.3f transactions/edge", (double)bus->xfers/replay_edges);
+	printf("\n");
+
+	end_zyncoder();
+	end_zyni2c();
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Switch Debounce Library
+ *
+ * Time-based debounce state machine for switches, shared by the
+ * ISR, polled, MCP23017 and HWC paths. Edges are accepted at once
+ * and followed by a settle (lockout) time. When the settle time
+ * ends, the last raw status is checked again from a timer thread.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "zyndebounce.h"
+
+//-----------------------------------------------------------------------------
+// Settle timer
+//-----------------------------------------------------------------------------
+
+pthread_t zyndebounce_tid;
+int zyndebounce_running=0;
+pthread_mutex_t zyndebounce_lock=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t zyndebounce_cond;
+unsigned long zyndebounce_next=0;
+void (*zyndebounce_expire_cb)(unsigned long tsus)=NULL;
+unsigned long (*zyndebounce_clock)(void)=NULL;
+
+unsigned long zyndebounce_get_tsus() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+//Wake the timer thread at deadline, if it's earlier than the scheduled one.
+//With a custom clock, the deadline is kept for zyndebounce_run().
+void zyndebounce_schedule(unsigned long deadline) {
+	if (!zyndebounce_running && !zyndebounce_clock) return;
+	pthread_mutex_lock(&zyndebounce_lock);
+	if (zyndebounce_next==0 || (long)(deadline-zyndebounce_next)<0) {
+		zyndebounce_next=deadline;
+		if (!zyndebounce_clock) pthread_cond_signal(&zyndebounce_cond);
+	}
+	pthread_mutex_unlock(&zyndebounce_lock);
+}
+
+void * zyndebounce_thread(void *arg) {
+	struct timespec ts;
+	unsigned long tsus;
+	while (1) {
+		pthread_mutex_lock(&zyndebounce_lock);
+		while (zyndebounce_running) {
+			if (zyndebounce_next==0 || zyndebounce_clock) {
+				pthread_cond_wait(&zyndebounce_cond, &zyndebounce_lock);
+				continue;
+			}
+			tsus=zyndebounce_get_tsus();
+			if ((long)(zyndebounce_next-tsus)<=0) break;
+			ts.tv_sec=zyndebounce_next/1000000;
+			ts.tv_nsec=(zyndebounce_next%1000000)*1000;
+			pthread_cond_timedwait(&zyndebounce_cond, &zyndebounce_lock, &ts);
+		}
+		if (!zyndebounce_running) {
+			pthread_mutex_unlock(&zyndebounce_lock);
+			break;
+		}
+		//Pending settle times are rescheduled by the callback
+		zyndebounce_next=0;
+		pthread_mutex_unlock(&zyndebounce_lock);
+		if (zyndebounce_expire_cb) zyndebounce_expire_cb(zyndebounce_get_tsus());
+	}
+	return NULL;
+}
+
+void set_zyndebounce_clock(unsigned long (*clock)(void)) {
+	zyndebounce_clock=clock;
+}
+
+//Settle times are ended in order, each one at its own deadline
+void zyndebounce_run(unsigned long tsus) {
+	unsigned long deadline;
+	while (1) {
+		pthread_mutex_lock(&zyndebounce_lock);
+		deadline=zyndebounce_next;
+		if (deadline==0 || (long)(deadline-tsus)>0) {
+			pthread_mutex_unlock(&zyndebounce_lock);
+			break;
+		}
+		//Pending settle times are rescheduled by the callback
+		zyndebounce_next=0;
+		pthread_mutex_unlock(&zyndebounce_lock);
+		if (zyndebounce_expire_cb) zyndebounce_expire_cb(deadline);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Debounce state machine
+//-----------------------------------------------------------------------------
+
+void setup_zyndebounce(struct zyndebounce_st *db, uint8_t status, unsigned int press_us, unsigned int release_us) {
+	db->state=ZYNDEBOUNCE_STABLE;
+	db->status=status;
+	db->raw=status;
+	db->deadline=0;
+	db->press_us=press_us;
+	db->release_us=release_us;
+}
+
+//Accept the raw status and start settling
+int zyndebounce_accept(struct zyndebounce_st *db, unsigned long tsus) {
+	db->status=db->raw;
+	unsigned int settle_us=db->status ? db->release_us : db->press_us;
+	if (settle_us>0) {
+		db->state=ZYNDEBOUNCE_SETTLING;
+		db->deadline=tsus+settle_us;
+		zyndebounce_schedule(db->deadline);
+	}
+	return 1;
+}
+
+int zyndebounce_update(struct zyndebounce_st *db, uint8_t raw, unsigned long tsus) {
+	db->raw=raw;
+	if (db->state==ZYNDEBOUNCE_SETTLING) {
+		//Bounce => it will be checked when settled
+		if ((long)(db->deadline-tsus)>0) return 0;
+		db->state=ZYNDEBOUNCE_STABLE;
+	}
+	if (db->raw==db->status) return 0;
+	return zyndebounce_accept(db, tsus);
+}
+
+int zyndebounce_expire(struct zyndebounce_st *db, unsigned long tsus) {
+	if (db->state!=ZYNDEBOUNCE_SETTLING) return 0;
+	if ((long)(db->deadline-tsus)>0) {
+		zyndebounce_schedule(db->deadline);
+		return 0;
+	}
+	db->state=ZYNDEBOUNCE_STABLE;
+	//Status changed while settling => accept the final one
+	if (db->raw==db->status) return 0;
+	return zyndebounce_accept(db, tsus);
+}
+
+//-----------------------------------------------------------------------------
+// Debounce Library Initialization
+//-----------------------------------------------------------------------------
+
+int init_zyndebounce(void (*expire_cb)(unsigned long tsus)) {
+	if (zyndebounce_running) return 1;
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&zyndebounce_cond, &attr);
+	pthread_condattr_destroy(&attr);
+	zyndebounce_expire_cb=expire_cb;
+	zyndebounce_next=0;
+	zyndebounce_running=1;
+	int err=pthread_create(&zyndebounce_tid, NULL, &zyndebounce_thread, NULL);
+	if (err != 0) {
+		zyndebounce_running=0;
+		fprintf(stderr, "ZynDebounce: Can't create settle timer thread :[%s]\n", strerror(err));
+		return 0;
+	}
+	return 1;
+}
+
+int end_zyndebounce() {
+	if (!zyndebounce_running) return 1;
+	pthread_mutex_lock(&zyndebounce_lock);
+	zyndebounce_running=0;
+	pthread_cond_signal(&zyndebounce_cond);
+	pthread_mutex_unlock(&zyndebounce_lock);
+	pthread_join(zyndebounce_tid, NULL);
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
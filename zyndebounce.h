@@ -0,0 +1,68 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Switch Debounce Library
+ *
+ * Time-based debounce state machine for switches, shared by the
+ * ISR, polled, MCP23017 and HWC paths. Edges are accepted at once
+ * and followed by a settle (lockout) time. When the settle time
+ * ends, the last raw status is checked again from a timer thread.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// Debounce state machine
+//-----------------------------------------------------------------------------
+
+//Default settle times => status 0 is pressed (closed), 1 is released (open)
+#define ZYNDEBOUNCE_DEFAULT_PRESS_US 5000
+#define ZYNDEBOUNCE_DEFAULT_RELEASE_US 5000
+
+#define ZYNDEBOUNCE_STABLE 0
+#define ZYNDEBOUNCE_SETTLING 1
+
+struct zyndebounce_st {
+	volatile uint8_t state;
+	volatile uint8_t status;		// debounced status
+	volatile uint8_t raw;			// last raw status
+	volatile unsigned long deadline;	// end of settle time
+	unsigned int press_us;
+	unsigned int release_us;
+};
+
+void setup_zyndebounce(struct zyndebounce_st *db, uint8_t status, unsigned int press_us, unsigned int release_us);
+
+//Feed a raw status (edge or poll). Returns 1 if the debounced status changed.
+int zyndebounce_update(struct zyndebounce_st *db, uint8_t raw, unsigned long tsus);
+//End the settle time if expired. Returns 1 if the debounced status changed.
+int zyndebounce_expire(struct zyndebounce_st *db, unsigned long tsus);
+
+//Settle timer thread => expire_cb is called when a settle time ends
+int init_zyndebounce(void (*expire_cb)(unsigned long tsus));
+int end_zyndebounce();
+
+//Custom (virtual) time source => the timer thread is not used and the owner
+//of the clock calls zyndebounce_run() when time advances. NULL => CLOCK_MONOTONIC.
+void set_zyndebounce_clock(unsigned long (*clock)(void));
+//Settle times ending up to tsus are run in order, each one at its deadline.
+void zyndebounce_run(unsigned long tsus);
+
+//-----------------------------------------------------------------------------
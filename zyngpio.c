@@ -0,0 +1,258 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: GPIO Character Device Backend
+ *
+ * Edge detection for native GPIOs using the Linux GPIO character
+ * device (uAPI v2). Edge events are read in batches, with the
+ * kernel timestamp, and passed to the line's handler.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/gpio.h>
+
+#if defined(HAVE_WIRINGPI_LIB)
+	#include <wiringPi.h>
+#endif
+
+#include "zyngpio.h"
+
+int zyngpio_chip_fd=-1;
+int zyngpio_epoll_fd=-1;
+int zyngpio_stop_fd=-1;
+int zyngpio_running=0;
+pthread_t zyngpio_tid;
+pthread_mutex_t zyngpio_lock=PTHREAD_MUTEX_INITIALIZER;
+
+//-----------------------------------------------------------------------------
+// GPIO Lines
+//-----------------------------------------------------------------------------
+
+//wiringPi pin numbers => BCM line offsets
+unsigned int zyngpio_pin_to_offset(uint8_t pin) {
+#if defined(HAVE_WIRINGPI_LIB)
+	return wpiPinToGpio(pin);
+#else
+	return pin;
+#endif
+}
+
+struct zyngpio_line_st *get_zyngpio_line(uint8_t pin) {
+	int i;
+	for (i=0;i<MAX_NUM_ZYNGPIO_LINES;i++) {
+		if (zyngpio_lines[i].enabled && zyngpio_lines[i].pin==pin) return zyngpio_lines+i;
+	}
+	return NULL;
+}
+
+int setup_zyngpio_line(uint8_t pin, uint8_t i, zyngpio_handler_t handler) {
+	if (zyngpio_chip_fd<0) return -1;
+
+	pthread_mutex_lock(&zyngpio_lock);
+	struct zyngpio_line_st *line=get_zyngpio_line(pin);
+	if (line) {
+		//Already requested => only change the handler
+		line->i=i;
+		line->handler=handler;
+		int level=line->level;
+		pthread_mutex_unlock(&zyngpio_lock);
+		return level;
+	}
+	int j;
+	for (j=0;j<MAX_NUM_ZYNGPIO_LINES;j++) {
+		if (!zyngpio_lines[j].enabled) {
+			line=zyngpio_lines+j;
+			break;
+		}
+	}
+	if (!line) {
+		pthread_mutex_unlock(&zyngpio_lock);
+		fprintf(stderr, "ZynGPIO: Maximum number of lines exceeded: %d\n", MAX_NUM_ZYNGPIO_LINES);
+		return -1;
+	}
+
+	struct gpio_v2_line_request req;
+	memset(&req, 0, sizeof(req));
+	req.offsets[0]=zyngpio_pin_to_offset(pin);
+	req.num_lines=1;
+	req.event_buffer_size=ZYNGPIO_EVENT_BATCH*4;
+	strncpy(req.consumer, ZYNGPIO_CONSUMER, GPIO_MAX_NAME_SIZE-1);
+	//Edge timestamps use CLOCK_MONOTONIC by default
+	req.config.flags=GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING | GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+	if (ioctl(zyngpio_chip_fd, GPIO_V2_GET_LINE_IOCTL, &req)<0) {
+		pthread_mutex_unlock(&zyngpio_lock);
+		fprintf(stderr, "ZynGPIO: Can't request line %d (pin %d) :[%s]\n", req.offsets[0], pin, strerror(errno));
+		return -1;
+	}
+
+	struct gpio_v2_line_values values;
+	values.mask=1;
+	values.bits=0;
+	ioctl(req.fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values);
+
+	line->pin=pin;
+	line->offset=req.offsets[0];
+	line->fd=req.fd;
+	line->level=values.bits & 0x1;
+	line->i=i;
+	line->handler=handler;
+	line->enabled=1;
+
+	struct epoll_event ev;
+	ev.events=EPOLLIN;
+	ev.data.ptr=line;
+	epoll_ctl(zyngpio_epoll_fd, EPOLL_CTL_ADD, line->fd, &ev);
+
+	pthread_mutex_unlock(&zyngpio_lock);
+	return line->level;
+}
+
+int get_zyngpio_level(uint8_t pin) {
+	struct zyngpio_line_st *line=get_zyngpio_line(pin);
+	if (!line) return -1;
+	return line->level;
+}
+
+//-----------------------------------------------------------------------------
+// Edge events thread
+//-----------------------------------------------------------------------------
+
+void zyngpio_read_events(struct zyngpio_line_st *line) {
+	struct gpio_v2_line_event events[ZYNGPIO_EVENT_BATCH];
+	int j, n;
+	n=read(line->fd, events, sizeof(events));
+	if (n<=0) return;
+	n/=sizeof(struct gpio_v2_line_event);
+	for (j=0;j<n;j++) {
+		line->level=(events[j].id==GPIO_V2_LINE_EVENT_RISING_EDGE);
+		if (line->handler) line->handler(line->i, line->pin, line->level, events[j].timestamp_ns/1000);
+	}
+}
+
+void * zyngpio_thread(void *arg) {
+	struct epoll_event evs[MAX_NUM_ZYNGPIO_LINES];
+	int j, n;
+	while (1) {
+		n=epoll_wait(zyngpio_epoll_fd, evs, MAX_NUM_ZYNGPIO_LINES, -1);
+		if (n<0) {
+			if (errno==EINTR) continue;
+			break;
+		}
+		pthread_mutex_lock(&zyngpio_lock);
+		for (j=0;j<n;j++) {
+			//Stop event => no line
+			if (!evs[j].data.ptr) {
+				pthread_mutex_unlock(&zyngpio_lock);
+				return NULL;
+			}
+			zyngpio_read_events((struct zyngpio_line_st *)evs[j].data.ptr);
+		}
+		pthread_mutex_unlock(&zyngpio_lock);
+	}
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// GPIO Backend Initialization
+//-----------------------------------------------------------------------------
+
+void zyngpio_close_fds() {
+	if (zyngpio_stop_fd>=0) close(zyngpio_stop_fd);
+	if (zyngpio_epoll_fd>=0) close(zyngpio_epoll_fd);
+	if (zyngpio_chip_fd>=0) close(zyngpio_chip_fd);
+	zyngpio_stop_fd=-1;
+	zyngpio_epoll_fd=-1;
+	zyngpio_chip_fd=-1;
+}
+
+int init_zyngpio_chip(const char *chip) {
+	int i;
+	if (zyngpio_running) return 1;
+	for (i=0;i<MAX_NUM_ZYNGPIO_LINES;i++) {
+		zyngpio_lines[i].enabled=0;
+		zyngpio_lines[i].fd=-1;
+	}
+	zyngpio_chip_fd=open(chip, O_RDWR | O_CLOEXEC);
+	if (zyngpio_chip_fd<0) {
+		fprintf(stderr, "ZynGPIO: Can't open GPIO chip %s :[%s]\n", chip, strerror(errno));
+		return 0;
+	}
+	zyngpio_epoll_fd=epoll_create1(EPOLL_CLOEXEC);
+	zyngpio_stop_fd=eventfd(0, EFD_CLOEXEC);
+	if (zyngpio_epoll_fd<0 || zyngpio_stop_fd<0) {
+		fprintf(stderr, "ZynGPIO: Can't create edge events poll :[%s]\n", strerror(errno));
+		zyngpio_close_fds();
+		return 0;
+	}
+	//The stop event has no line => data.ptr is NULL
+	struct epoll_event ev;
+	ev.events=EPOLLIN;
+	ev.data.ptr=NULL;
+	epoll_ctl(zyngpio_epoll_fd, EPOLL_CTL_ADD, zyngpio_stop_fd, &ev);
+	int err=pthread_create(&zyngpio_tid, NULL, &zyngpio_thread, NULL);
+	if (err != 0) {
+		fprintf(stderr, "ZynGPIO: Can't create edge events thread :[%s]\n", strerror(err));
+		zyngpio_close_fds();
+		return 0;
+	}
+	zyngpio_running=1;
+	printf("ZynGPIO: Edge events thread created successfully (%s)\n", chip);
+	return 1;
+}
+
+int init_zyngpio() {
+	return init_zyngpio_chip(ZYNGPIO_CHIP);
+}
+
+int end_zyngpio() {
+	int i;
+	if (!zyngpio_running) return 1;
+	//Wake & join the edge events thread before closing the fds it's polling
+	uint64_t val=1;
+	if (write(zyngpio_stop_fd, &val, sizeof(val))!=sizeof(val)) {
+		fprintf(stderr, "ZynGPIO: Can't stop edge events thread :[%s]\n", strerror(errno));
+		return 0;
+	}
+	pthread_join(zyngpio_tid, NULL);
+	zyngpio_running=0;
+	pthread_mutex_lock(&zyngpio_lock);
+	for (i=0;i<MAX_NUM_ZYNGPIO_LINES;i++) {
+		if (zyngpio_lines[i].enabled) {
+			zyngpio_lines[i].enabled=0;
+			close(zyngpio_lines[i].fd);
+			zyngpio_lines[i].fd=-1;
+		}
+	}
+	zyngpio_close_fds();
+	pthread_mutex_unlock(&zyngpio_lock);
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
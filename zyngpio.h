@@ -0,0 +1,67 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: GPIO Character Device Backend
+ *
+ * Edge detection for native GPIOs using the Linux GPIO character
+ * device (uAPI v2). Edge events are read in batches, with the
+ * kernel timestamp, and passed to the line's handler.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// GPIO Lines
+//-----------------------------------------------------------------------------
+
+//GPIO chip device => can be set to a gpio-sim chip for testing
+#if !defined(ZYNGPIO_CHIP)
+	#define ZYNGPIO_CHIP "/dev/gpiochip0"
+#endif
+
+#define MAX_NUM_ZYNGPIO_LINES 32
+#define ZYNGPIO_EVENT_BATCH 16
+#define ZYNGPIO_CONSUMER "zyncoder"
+
+//Edge handler => i is the index passed to setup_zyngpio_line, tsus the kernel edge time (CLOCK_MONOTONIC)
+typedef void (*zyngpio_handler_t)(uint8_t i, uint8_t pin, uint8_t level, unsigned long tsus);
+
+struct zyngpio_line_st {
+	uint8_t enabled;
+	uint8_t pin;				// wiringPi pin number
+	unsigned int offset;		// line offset in the GPIO chip
+	int fd;
+	volatile uint8_t level;		// level after the last edge
+	uint8_t i;
+	zyngpio_handler_t handler;
+};
+struct zyngpio_line_st zyngpio_lines[MAX_NUM_ZYNGPIO_LINES];
+
+int init_zyngpio();
+//Open another chip than ZYNGPIO_CHIP (i.e. a gpio-sim chip created at run time)
+int init_zyngpio_chip(const char *chip);
+//Stop & join the edge events thread and release all the lines
+int end_zyngpio();
+
+//Request the pin as input with pull-up & edge detection. Returns the current level or -1 on error.
+int setup_zyngpio_line(uint8_t pin, uint8_t i, zyngpio_handler_t handler);
+int get_zyngpio_level(uint8_t pin);
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,194 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: ZynGPIO Tests
+ *
+ * Tests the GPIO character device backend against a gpio-sim chip
+ * (kernel module gpio-sim, configured through configfs): levels,
+ * kernel edge timestamps, edge batches and the backend shutdown.
+ * Must be run as root, with configfs mounted & gpio-sim loaded.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "zyngpio.h"
+
+//Enough lines for the wiringPi => BCM mapping
+#define SIM_NUM_LINES 32
+#define SIM_CONFIG_DIR "/sys/kernel/config/gpio-sim/zyngpio_test"
+#define TEST_PIN 2
+#define TEST_BURST 8
+#define TEST_TIMEOUT_US 1000000
+
+char sim_dev_name[64];
+char sim_chip_name[64];
+int test_failed=0;
+
+volatile int test_nevents=0;
+volatile uint8_t test_level=0;
+volatile unsigned long test_tsus=0;
+
+unsigned long get_tsus() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+void test_check(int cond, const char *msg) {
+	printf("  %s => %s\n", msg, cond ? "OK" : "FAIL");
+	if (!cond) test_failed=1;
+}
+
+//-----------------------------------------------------------------------------
+// gpio-sim chip
+//-----------------------------------------------------------------------------
+
+int write_attr(const char *path, const char *val) {
+	FILE *f=fopen(path, "w");
+	if (!f) return 0;
+	int res=(fputs(val, f)>=0);
+	if (fclose(f)!=0) res=0;
+	return res;
+}
+
+int read_attr(const char *path, char *val, int size) {
+	FILE *f=fopen(path, "r");
+	if (!f) return 0;
+	int res=(fgets(val, size, f)!=NULL);
+	fclose(f);
+	if (res) val[strcspn(val, "\n")]=0;
+	return res;
+}
+
+void destroy_sim() {
+	write_attr(SIM_CONFIG_DIR "/live", "0");
+	rmdir(SIM_CONFIG_DIR "/bank0");
+	rmdir(SIM_CONFIG_DIR);
+}
+
+int create_sim() {
+	char nl[8];
+	if (mkdir(SIM_CONFIG_DIR, 0755)!=0) return 0;
+	snprintf(nl, sizeof(nl), "%d", SIM_NUM_LINES);
+	if (mkdir(SIM_CONFIG_DIR "/bank0", 0755)!=0 ||
+		!write_attr(SIM_CONFIG_DIR "/bank0/num_lines", nl) ||
+		!write_attr(SIM_CONFIG_DIR "/live", "1") ||
+		!read_attr(SIM_CONFIG_DIR "/dev_name", sim_dev_name, sizeof(sim_dev_name)) ||
+		!read_attr(SIM_CONFIG_DIR "/bank0/chip_name", sim_chip_name, sizeof(sim_chip_name))) {
+		destroy_sim();
+		return 0;
+	}
+	return 1;
+}
+
+//Drive the simulated line => the input follows the pull
+int set_sim_pull(unsigned int offset, uint8_t level) {
+	char path[256];
+	snprintf(path, sizeof(path), "/sys/devices/platform/%s/%s/sim_gpio%u/pull", sim_dev_name, sim_chip_name, offset);
+	return write_attr(path, level ? "pull-up" : "pull-down");
+}
+
+//-----------------------------------------------------------------------------
+// Tests
+//-----------------------------------------------------------------------------
+
+void test_handler(uint8_t i, uint8_t pin, uint8_t level, unsigned long tsus) {
+	test_level=level;
+	test_tsus=tsus;
+	__atomic_add_fetch(&test_nevents, 1, __ATOMIC_RELEASE);
+}
+
+int wait_events(int n) {
+	unsigned long t0=get_tsus();
+	while (__atomic_load_n(&test_nevents, __ATOMIC_ACQUIRE)<n) {
+		if (get_tsus()-t0>TEST_TIMEOUT_US) return 0;
+		usleep(100);
+	}
+	return 1;
+}
+
+unsigned int get_test_offset() {
+	int k;
+	for (k=0;k<MAX_NUM_ZYNGPIO_LINES;k++) {
+		if (zyngpio_lines[k].enabled && zyngpio_lines[k].pin==TEST_PIN) return zyngpio_lines[k].offset;
+	}
+	return SIM_NUM_LINES;
+}
+
+void test_edges(const char *chip) {
+	int k;
+	printf("EDGES:\n");
+	test_check(init_zyngpio_chip(chip), "init_zyngpio_chip");
+	test_check(setup_zyngpio_line(TEST_PIN, 3, test_handler)==1, "pull-up level after setup");
+	unsigned int offset=get_test_offset();
+	test_check(offset<SIM_NUM_LINES, "line offset");
+	if (offset>=SIM_NUM_LINES) return;
+
+	//Single edges => level & kernel timestamp between the pull change and the handler call
+	for (k=0;k<4;k++) {
+		uint8_t level=k & 0x1;
+		int n=test_nevents;
+		unsigned long t0=get_tsus();
+		set_sim_pull(offset, level);
+		int res=wait_events(n+1);
+		unsigned long t1=get_tsus();
+		test_check(res && test_level==level, level ? "rising edge" : "falling edge");
+		test_check(res && test_tsus>=t0 && test_tsus<=t1, "edge timestamp");
+	}
+
+	//Burst => every edge is read, in order
+	int n=test_nevents;
+	for (k=0;k<TEST_BURST;k++) set_sim_pull(offset, k & 0x1);
+	test_check(wait_events(n+TEST_BURST), "edges burst");
+	test_check(test_level==((TEST_BURST-1) & 0x1), "level after burst");
+
+	//Shutdown => thread joined, lines released. No more handler calls.
+	test_check(end_zyngpio(), "end_zyngpio");
+	test_check(zyngpio_lines[0].fd==-1 && !zyngpio_lines[0].enabled, "lines released");
+	n=test_nevents;
+	set_sim_pull(offset, 1);
+	usleep(10000);
+	test_check(test_nevents==n, "no edges after end");
+}
+
+int main(int argc, char *argv[]) {
+	char chip[128];
+
+	if (!create_sim()) {
+		fprintf(stderr, "ZynGPIOTest: Can't create gpio-sim chip. Is configfs mounted & gpio-sim loaded?\n");
+		return 77;
+	}
+	snprintf(chip, sizeof(chip), "/dev/%s", sim_chip_name);
+	printf("ZynGPIOTest: Using gpio-sim chip %s (%s)\n", chip, sim_dev_name);
+
+	test_edges(chip);
+	//Init after end => starts again from a clean state
+	test_edges(chip);
+
+	destroy_sim();
+	printf("ZynGPIOTest: %s\n", test_failed ? "FAILED" : "PASSED");
+	return test_failed;
+}
@@ -0,0 +1,298 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: I2C Bus Scheduler
+ *
+ * A single thread owns the I2C bus and runs the transactions
+ * requested by the hardware drivers (MCP23017, ADS1115, MCP4728,
+ * TCA954x/VL53L0X, riban HWC), taking them from per-priority
+ * queues, so control reads are never stuck behind sensor traffic.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "zyni2c.h"
+#if !defined(HAVE_WIRINGPI_LIB)
+	#include "zyni2cemu.h"
+#endif
+
+//-----------------------------------------------------------------------------
+// Transaction queues
+//-----------------------------------------------------------------------------
+
+struct zyni2c_queue_st {
+	struct zyni2c_xfer_st *xfers[ZYNI2C_QUEUE_SIZE];
+	unsigned int head;
+	unsigned int tail;
+};
+
+struct zyni2c_queue_st zyni2c_queues[ZYNI2C_NUM_PRIOS];
+
+int zyni2c_fd=-1;
+pthread_t zyni2c_tid;
+int zyni2c_running=0;
+pthread_mutex_t zyni2c_lock=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t zyni2c_cond=PTHREAD_COND_INITIALIZER;
+//Producers wait here when their queue is full
+pthread_cond_t zyni2c_space_cond=PTHREAD_COND_INITIALIZER;
+
+//Must be called with zyni2c_lock held
+struct zyni2c_xfer_st *zyni2c_dequeue() {
+	int p;
+	for (p=0;p<ZYNI2C_NUM_PRIOS;p++) {
+		struct zyni2c_queue_st *q=zyni2c_queues+p;
+		if (q->head!=q->tail) {
+			struct zyni2c_xfer_st *xfer=q->xfers[q->tail];
+			q->tail=(q->tail+1) % ZYNI2C_QUEUE_SIZE;
+			return xfer;
+		}
+	}
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Bus access
+//-----------------------------------------------------------------------------
+
+int zyni2c_rdwr(struct i2c_msg *msgs, int n) {
+#if defined(HAVE_WIRINGPI_LIB)
+	struct i2c_rdwr_ioctl_data rdwr;
+	rdwr.msgs=msgs;
+	rdwr.nmsgs=n;
+	if (ioctl(zyni2c_fd, I2C_RDWR, &rdwr)<0) return -1;
+	return 0;
+#else
+	return zyni2cemu_rdwr(msgs, n);
+#endif
+}
+
+int zyni2c_exec(struct zyni2c_xfer_st *xfer) {
+	struct i2c_msg msgs[2];
+	uint8_t buffer[ZYNI2C_MAX_DATA+1];
+
+	switch (xfer->op) {
+		case ZYNI2C_OP_READ:
+			msgs[0].addr=xfer->addr;
+			msgs[0].flags=I2C_M_RD;
+			msgs[0].len=xfer->len;
+			msgs[0].buf=xfer->data;
+			return zyni2c_rdwr(msgs, 1);
+		case ZYNI2C_OP_READ_REG:
+			msgs[0].addr=xfer->addr;
+			msgs[0].flags=0;
+			msgs[0].len=1;
+			msgs[0].buf=&xfer->reg;
+			msgs[1].addr=xfer->addr;
+			msgs[1].flags=I2C_M_RD;
+			msgs[1].len=xfer->len;
+			msgs[1].buf=xfer->data;
+			return zyni2c_rdwr(msgs, 2);
+		case ZYNI2C_OP_WRITE_REG:
+			buffer[0]=xfer->reg;
+			memcpy(buffer+1, xfer->data, xfer->len);
+			msgs[0].addr=xfer->addr;
+			msgs[0].flags=0;
+			msgs[0].len=xfer->len+1;
+			msgs[0].buf=buffer;
+			return zyni2c_rdwr(msgs, 1);
+		case ZYNI2C_OP_CALL:
+			return xfer->func(xfer->arg);
+	}
+	return -1;
+}
+
+void * zyni2c_thread(void *arg) {
+	struct zyni2c_xfer_st *xfer;
+	while (1) {
+		pthread_mutex_lock(&zyni2c_lock);
+		//Pending transactions are served before ending
+		while (!(xfer=zyni2c_dequeue())) {
+			if (!zyni2c_running) {
+				pthread_mutex_unlock(&zyni2c_lock);
+				return NULL;
+			}
+			pthread_cond_wait(&zyni2c_cond, &zyni2c_lock);
+		}
+		pthread_cond_broadcast(&zyni2c_space_cond);
+		pthread_mutex_unlock(&zyni2c_lock);
+		xfer->result=zyni2c_exec(xfer);
+		sem_post(&xfer->done);
+	}
+}
+
+//Queue the transaction and wait until it's done. If not running (or called from
+//the bus thread, i.e. from a ZYNI2C_OP_CALL function), it's executed in place.
+int zyni2c_submit(uint8_t prio, struct zyni2c_xfer_st *xfer) {
+	if (zyni2c_fd<0 && xfer->op!=ZYNI2C_OP_CALL) return -1;
+	if (xfer->op!=ZYNI2C_OP_CALL && xfer->len>ZYNI2C_MAX_DATA) {
+		fprintf(stderr, "ZynI2C: Transaction too long (%d bytes).\n", xfer->len);
+		return -1;
+	}
+	if (!zyni2c_running || pthread_equal(pthread_self(), zyni2c_tid)) {
+		return zyni2c_exec(xfer);
+	}
+	if (prio>=ZYNI2C_NUM_PRIOS) prio=ZYNI2C_NUM_PRIOS-1;
+
+	sem_init(&xfer->done, 0, 0);
+	pthread_mutex_lock(&zyni2c_lock);
+	struct zyni2c_queue_st *q=zyni2c_queues+prio;
+	while ((q->head+1) % ZYNI2C_QUEUE_SIZE == q->tail) {
+		pthread_cond_wait(&zyni2c_space_cond, &zyni2c_lock);
+	}
+	q->xfers[q->head]=xfer;
+	q->head=(q->head+1) % ZYNI2C_QUEUE_SIZE;
+	pthread_cond_signal(&zyni2c_cond);
+	pthread_mutex_unlock(&zyni2c_lock);
+
+	while (sem_wait(&xfer->done)!=0 && errno==EINTR);
+	sem_destroy(&xfer->done);
+	return xfer->result;
+}
+
+//-----------------------------------------------------------------------------
+// Transactions
+//-----------------------------------------------------------------------------
+
+int zyni2c_read(uint8_t prio, uint8_t addr, uint8_t *data, uint8_t len) {
+	struct zyni2c_xfer_st xfer;
+	xfer.op=ZYNI2C_OP_READ;
+	xfer.addr=addr;
+	xfer.len=len;
+	xfer.data=data;
+	return zyni2c_submit(prio, &xfer);
+}
+
+int zyni2c_read_reg(uint8_t prio, uint8_t addr, uint8_t reg, uint8_t *data, uint8_t len) {
+	struct zyni2c_xfer_st xfer;
+	xfer.op=ZYNI2C_OP_READ_REG;
+	xfer.addr=addr;
+	xfer.reg=reg;
+	xfer.len=len;
+	xfer.data=data;
+	return zyni2c_submit(prio, &xfer);
+}
+
+int zyni2c_write_reg(uint8_t prio, uint8_t addr, uint8_t reg, const uint8_t *data, uint8_t len) {
+	struct zyni2c_xfer_st xfer;
+	xfer.op=ZYNI2C_OP_WRITE_REG;
+	xfer.addr=addr;
+	xfer.reg=reg;
+	xfer.len=len;
+	xfer.data=(uint8_t *)data;
+	return zyni2c_submit(prio, &xfer);
+}
+
+int zyni2c_call(uint8_t prio, int (*func)(void *), void *arg) {
+	struct zyni2c_xfer_st xfer;
+	xfer.op=ZYNI2C_OP_CALL;
+	xfer.func=func;
+	xfer.arg=arg;
+	return zyni2c_submit(prio, &xfer);
+}
+
+int zyni2c_read_byte(uint8_t prio, uint8_t addr) {
+	uint8_t val;
+	if (zyni2c_read(prio, addr, &val, 1)<0) return -1;
+	return val;
+}
+
+int zyni2c_read_reg8(uint8_t prio, uint8_t addr, uint8_t reg) {
+	uint8_t val;
+	if (zyni2c_read_reg(prio, addr, reg, &val, 1)<0) return -1;
+	return val;
+}
+
+int zyni2c_read_reg16(uint8_t prio, uint8_t addr, uint8_t reg) {
+	uint8_t data[2];
+	if (zyni2c_read_reg(prio, addr, reg, data, 2)<0) return -1;
+	return (data[0] << 8) | data[1];
+}
+
+int zyni2c_write_reg8(uint8_t prio, uint8_t addr, uint8_t reg, uint8_t val) {
+	return zyni2c_write_reg(prio, addr, reg, &val, 1);
+}
+
+int zyni2c_write_reg16(uint8_t prio, uint8_t addr, uint8_t reg, uint16_t val) {
+	uint8_t data[2];
+	data[0]=(val >> 8) & 0xFF;
+	data[1]=val & 0xFF;
+	return zyni2c_write_reg(prio, addr, reg, data, 2);
+}
+
+//-----------------------------------------------------------------------------
+// I2C Bus Scheduler Initialization
+//-----------------------------------------------------------------------------
+
+int init_zyni2c() {
+	int p;
+	if (zyni2c_running) return 1;
+	for (p=0;p<ZYNI2C_NUM_PRIOS;p++) {
+		zyni2c_queues[p].head=0;
+		zyni2c_queues[p].tail=0;
+	}
+#if defined(HAVE_WIRINGPI_LIB)
+	zyni2c_fd=open(ZYNI2C_DEVICE, O_RDWR);
+	if (zyni2c_fd<0) {
+		fprintf(stderr, "ZynI2C: Can't open I2C bus %s :[%s]\n", ZYNI2C_DEVICE, strerror(errno));
+		return 0;
+	}
+#else
+	if (!init_zyni2cemu()) return 0;
+	zyni2c_fd=0;
+#endif
+	zyni2c_running=1;
+	int err=pthread_create(&zyni2c_tid, NULL, &zyni2c_thread, NULL);
+	if (err != 0) {
+		zyni2c_running=0;
+		fprintf(stderr, "ZynI2C: Can't create bus thread :[%s]\n", strerror(err));
+		return 0;
+	}
+	printf("ZynI2C: Bus thread created successfully\n");
+	return 1;
+}
+
+int end_zyni2c() {
+	if (!zyni2c_running) return 1;
+	pthread_mutex_lock(&zyni2c_lock);
+	zyni2c_running=0;
+	pthread_cond_signal(&zyni2c_cond);
+	pthread_mutex_unlock(&zyni2c_lock);
+	pthread_join(zyni2c_tid, NULL);
+#if defined(HAVE_WIRINGPI_LIB)
+	close(zyni2c_fd);
+#else
+	end_zyni2cemu();
+#endif
+	zyni2c_fd=-1;
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,86 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: I2C Bus Scheduler
+ *
+ * A single thread owns the I2C bus and runs the transactions
+ * requested by the hardware drivers (MCP23017, ADS1115, MCP4728,
+ * TCA954x/VL53L0X, riban HWC), taking them from per-priority
+ * queues, so control reads are never stuck behind sensor traffic.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+//-----------------------------------------------------------------------------
+// I2C Bus Scheduler
+//-----------------------------------------------------------------------------
+
+#if !defined(ZYNI2C_DEVICE)
+	#define ZYNI2C_DEVICE "/dev/i2c-1"
+#endif
+
+//Queue priorities => lower value is served first
+#define ZYNI2C_PRIO_CONTROL 0	// encoders & switches
+#define ZYNI2C_PRIO_OUTPUT 1	// CV/Gate outputs
+#define ZYNI2C_PRIO_SENSOR 2	// CV-IN, TOF sensors, etc.
+#define ZYNI2C_NUM_PRIOS 3
+
+#define ZYNI2C_QUEUE_SIZE 32
+#define ZYNI2C_MAX_DATA 32
+
+enum zyni2c_op_enum {
+	ZYNI2C_OP_READ,			// read data
+	ZYNI2C_OP_READ_REG,		// write register address & read data (repeated start)
+	ZYNI2C_OP_WRITE_REG,	// write register address & data
+	ZYNI2C_OP_CALL			// run a function on the bus thread (libraries with their own fd)
+};
+
+struct zyni2c_xfer_st {
+	enum zyni2c_op_enum op;
+	uint8_t addr;
+	uint8_t reg;
+	uint8_t len;
+	uint8_t *data;
+	int (*func)(void *);
+	void *arg;
+	int result;
+	sem_t done;
+};
+
+int init_zyni2c();
+int end_zyni2c();
+
+//Synchronous transactions: the caller is blocked until the transaction is done.
+//They return 0 on success (or the function result for zyni2c_call), -1 on error.
+int zyni2c_read(uint8_t prio, uint8_t addr, uint8_t *data, uint8_t len);
+int zyni2c_read_reg(uint8_t prio, uint8_t addr, uint8_t reg, uint8_t *data, uint8_t len);
+int zyni2c_write_reg(uint8_t prio, uint8_t addr, uint8_t reg, const uint8_t *data, uint8_t len);
+int zyni2c_call(uint8_t prio, int (*func)(void *), void *arg);
+
+//Helpers => return the value or -1 on error. 16 bits values are big-endian on the bus.
+int zyni2c_read_byte(uint8_t prio, uint8_t addr);
+int zyni2c_read_reg8(uint8_t prio, uint8_t addr, uint8_t reg);
+int zyni2c_read_reg16(uint8_t prio, uint8_t addr, uint8_t reg);
+int zyni2c_write_reg8(uint8_t prio, uint8_t addr, uint8_t reg, uint8_t val);
+int zyni2c_write_reg16(uint8_t prio, uint8_t addr, uint8_t reg, uint16_t val);
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,964 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Emulated I2C Devices
+ *
+ * Userspace I2C bus with register models of the MCP23008/MCP23017
+ * expanders, ADS1115 ADC, MCP4728 DAC, TCA954X multiplexer, VL53L0X
+ * TOF sensor and riban HWC, so the full driver stack can be run and
+ * benchmarked without hardware. The bus timing is configurable and
+ * transactions are counted per device.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "zyni2cemu.h"
+#include "zyni2c.h"
+#include "wiringPiEmu.h"
+
+//-----------------------------------------------------------------------------
+// Default board => same wiring defaults as the drivers
+//-----------------------------------------------------------------------------
+
+// riban HWC => address, interrupt pin & bulk readout register (as in zyncoder_i2c)
+#define HWC_I2C_ADDRESS 0x08
+#if !defined(MCP23017_INTA_PIN)
+	#define HWC_INT_PIN 7
+#else
+	#define HWC_INT_PIN MCP23017_INTA_PIN
+#endif
+
+#if !defined(MCP23017_I2C_ADDRESS)
+	#define MCP23017_I2C_ADDRESS 0x20
+#endif
+#if !defined(MCP23017_INTA_PIN)
+	#define MCP23017_INTA_PIN 27
+#endif
+#if !defined(MCP23017_INTB_PIN)
+	#define MCP23017_INTB_PIN 25
+#endif
+#if !defined(MCP23008_INT_PIN)
+	#define MCP23008_INT_PIN -1
+#endif
+#define EXPANDER_BASE_PIN 100
+#define MCP23008_I2C_ADDRESS 0x20
+
+#if defined(ZYNAPTIK_CONFIG)
+	#if !defined(ZYNAPTIK_MCP23017_I2C_ADDRESS)
+		#define ZYNAPTIK_MCP23017_I2C_ADDRESS 0x21
+	#endif
+	#if !defined(ZYNAPTIK_MCP23017_BASE_PIN)
+		#define ZYNAPTIK_MCP23017_BASE_PIN 200
+	#endif
+	#if !defined(ZYNAPTIK_MCP23017_INTA_PIN)
+		#define ZYNAPTIK_MCP23017_INTA_PIN 27
+	#endif
+	#if !defined(ZYNAPTIK_MCP23017_INTB_PIN)
+		#define ZYNAPTIK_MCP23017_INTB_PIN 25
+	#endif
+	#if !defined(ZYNAPTIK_ADS1115_I2C_ADDRESS)
+		#define ZYNAPTIK_ADS1115_I2C_ADDRESS 0x48
+	#endif
+	#if !defined(ZYNAPTIK_MCP4728_I2C_ADDRESS)
+		#if ZYNAPTIK_VERSION==1
+			#define ZYNAPTIK_MCP4728_I2C_ADDRESS 0x60
+		#else
+			#define ZYNAPTIK_MCP4728_I2C_ADDRESS 0x61
+		#endif
+	#endif
+#endif
+
+#define TCA954X_I2C_ADDRESS 0x70
+#define VL53L0X_I2C_ADDRESS 0x29
+
+#define HWC_REG_BULK 0xF0
+#define HWC_BULK_MORE 0x80
+
+#define VL53L0X_SAMPLE_US 33000
+
+//-----------------------------------------------------------------------------
+// Emulated I2C Bus
+//-----------------------------------------------------------------------------
+
+pthread_mutex_t zyni2cemu_lock=PTHREAD_MUTEX_INITIALIZER;
+unsigned int zyni2cemu_bus_hz=ZYNI2CEMU_DEFAULT_BUS_HZ;
+unsigned int zyni2cemu_xfer_us=ZYNI2CEMU_DEFAULT_XFER_US;
+unsigned long (*zyni2cemu_clock)(void)=NULL;
+struct zyni2cemu_dev_st *zyni2cemu_mux=NULL;
+struct wpiemu_shm_st *zyni2cemu_shm=NULL;
+
+unsigned long zyni2cemu_get_tsus() {
+	if (zyni2cemu_clock) return zyni2cemu_clock();
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+void set_zyni2cemu_clock(unsigned long (*clock)(void)) {
+	zyni2cemu_clock=clock;
+}
+
+void set_zyni2cemu_timing(unsigned int bus_hz, unsigned int xfer_us) {
+	zyni2cemu_bus_hz=bus_hz;
+	zyni2cemu_xfer_us=xfer_us;
+}
+
+void reset_zyni2cemu_stats() {
+	int i;
+	pthread_mutex_lock(&zyni2cemu_lock);
+	for (i=0;i<ZYNI2CEMU_MAX_DEVICES;i++) memset(&zyni2cemu_devs[i].stats, 0, sizeof(struct zyni2cemu_stats_st));
+	memset(&zyni2cemu_bus_stats, 0, sizeof(struct zyni2cemu_stats_st));
+	zyni2cemu_nacks=0;
+	pthread_mutex_unlock(&zyni2cemu_lock);
+}
+
+//Drive an output pin (INT lines) => edge in the virtual GPIO
+void zyni2cemu_set_pin(int16_t pin, uint8_t *level, uint8_t value) {
+	if (pin<0 || *level==value) return;
+	*level=value;
+	if (!zyni2cemu_shm) zyni2cemu_shm=wpiemu_attach();
+	if (!zyni2cemu_shm) return;
+	// on the edges thread => time of the edge being dispatched
+	uint64_t tsus=wiringPiEmuEdgeTsus();
+	if (!tsus) tsus=zyni2cemu_get_tsus();
+	if (wpiemu_push_edge(zyni2cemu_shm, pin, value, tsus)) wpiemu_notify(zyni2cemu_shm);
+}
+
+//Devices behind the multiplexer answer when their channel is enabled
+struct zyni2cemu_dev_st *zyni2cemu_find(uint8_t addr) {
+	int i;
+	for (i=0;i<ZYNI2CEMU_MAX_DEVICES;i++) {
+		struct zyni2cemu_dev_st *dev=zyni2cemu_devs+i;
+		if (!dev->enabled || dev->addr!=addr) continue;
+		if (dev->mux_chan<0) return dev;
+		if (zyni2cemu_mux && (zyni2cemu_mux->tca954x.control & (1<<dev->mux_chan))) return dev;
+	}
+	return NULL;
+}
+
+void zyni2cemu_write(struct zyni2cemu_dev_st *dev, uint8_t *buf, int len);
+void zyni2cemu_read(struct zyni2cemu_dev_st *dev, uint8_t *buf, int len, int ptr_set);
+
+int zyni2cemu_rdwr(struct i2c_msg *msgs, int n) {
+	int i, res=0, ptr_set=0;
+	unsigned long bits=1;	// stop
+	struct zyni2cemu_dev_st *dev, *first=NULL;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	pthread_mutex_lock(&zyni2cemu_lock);
+	for (i=0;i<n;i++) {
+		// start & address byte
+		bits+=10;
+		dev=zyni2cemu_find(msgs[i].addr);
+		if (!dev) {
+			zyni2cemu_nacks++;
+			res=-1;
+			break;
+		}
+		if (!first) first=dev;
+		bits+=9*msgs[i].len;
+		dev->stats.msgs++;
+		zyni2cemu_bus_stats.msgs++;
+		if (msgs[i].flags & I2C_M_RD) {
+			zyni2cemu_read(dev, msgs[i].buf, msgs[i].len, ptr_set);
+			dev->stats.bytes_read+=msgs[i].len;
+			zyni2cemu_bus_stats.bytes_read+=msgs[i].len;
+		} else {
+			zyni2cemu_write(dev, msgs[i].buf, msgs[i].len);
+			if (msgs[i].len>0) ptr_set=1;
+			dev->stats.bytes_written+=msgs[i].len;
+			zyni2cemu_bus_stats.bytes_written+=msgs[i].len;
+		}
+	}
+	unsigned long dtus=0;
+	if (zyni2cemu_bus_hz>0) dtus=zyni2cemu_xfer_us + bits*1000000/zyni2cemu_bus_hz;
+	zyni2cemu_bus_stats.xfers++;
+	zyni2cemu_bus_stats.bus_us+=dtus;
+	if (first) {
+		first->stats.xfers++;
+		first->stats.bus_us+=dtus;
+	}
+	pthread_mutex_unlock(&zyni2cemu_lock);
+
+	// the bus is busy until the transaction ends
+	if (dtus>0) {
+		ts.tv_nsec+=dtus*1000;
+		ts.tv_sec+=ts.tv_nsec/1000000000;
+		ts.tv_nsec%=1000000000;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)==EINTR);
+	}
+	return res;
+}
+
+//-----------------------------------------------------------------------------
+// MCP23008 & MCP23017 => IOCON.BANK=0 register map
+//-----------------------------------------------------------------------------
+
+//MCP23008 registers are the port A registers of the MCP23017
+uint8_t mcp23x17_reg(struct zyni2cemu_dev_st *dev, uint8_t ptr) {
+	if (dev->type==ZYNI2CEMU_MCP23008) return ptr<<1;
+	return ptr;
+}
+
+uint8_t mcp23x17_next_ptr(struct zyni2cemu_dev_st *dev, uint8_t ptr) {
+	// sequential operation disabled => the pointer doesn't move
+	if (dev->regs[MCP23x17_IOCON] & IOCON_SEQOP) return ptr;
+	if (dev->type==ZYNI2CEMU_MCP23008) return (ptr+1) % (MCP23x08_OLAT+1);
+	return (ptr+1) % (MCP23x17_OLATB+1);
+}
+
+//Port value => inputs from the virtual GPIO pins, outputs from the latch
+uint8_t mcp23x17_gpio(struct zyni2cemu_dev_st *dev, uint8_t port) {
+	int i;
+	uint8_t val=0;
+	for (i=0;i<8;i++) {
+		if (digitalRead(dev->mcp23x17.base_pin + port*8 + i)) val|=1<<i;
+	}
+	uint8_t iodir=dev->regs[MCP23x17_IODIRA+port];
+	val^=dev->regs[MCP23x17_IPOLA+port];
+	return (val & iodir) | (dev->regs[MCP23x17_OLATA+port] & ~iodir);
+}
+
+void mcp23x17_update_int(struct zyni2cemu_dev_st *dev) {
+	int p;
+	uint8_t iocon=dev->regs[MCP23x17_IOCON];
+	uint8_t active[2];
+	active[0]=dev->regs[MCP23x17_INTFA]!=0;
+	active[1]=dev->regs[MCP23x17_INTFB]!=0;
+	if (iocon & IOCON_MIRROR) active[0]=active[1]=active[0] || active[1];
+	for (p=0;p<2;p++) {
+		// open-drain => active low (pulled up)
+		uint8_t level=((iocon & IOCON_INTPOL) && !(iocon & IOCON_ODR)) ? active[p] : !active[p];
+		zyni2cemu_set_pin(dev->mcp23x17.int_pins[p], dev->mcp23x17.int_levels+p, level);
+	}
+}
+
+void mcp23x17_clear_int(struct zyni2cemu_dev_st *dev, uint8_t port) {
+	dev->regs[MCP23x17_INTFA+port]=0;
+	mcp23x17_update_int(dev);
+}
+
+uint8_t mcp23x17_read(struct zyni2cemu_dev_st *dev, uint8_t reg) {
+	uint8_t val, port=reg & 0x1;
+	switch (reg & ~0x1) {
+		// reading the port or the captured value clears the interrupt
+		case MCP23x17_GPIOA:
+			val=mcp23x17_gpio(dev, port);
+			mcp23x17_clear_int(dev, port);
+			return val;
+		case MCP23x17_INTCAPA:
+			val=dev->regs[reg];
+			mcp23x17_clear_int(dev, port);
+			return val;
+	}
+	return dev->regs[reg];
+}
+
+void mcp23x17_write(struct zyni2cemu_dev_st *dev, uint8_t reg, uint8_t val) {
+	uint8_t port=reg & 0x1;
+	switch (reg & ~0x1) {
+		// IOCON is shared by both ports. BANK=1 is not emulated.
+		case MCP23x17_IOCON:
+			dev->regs[MCP23x17_IOCON]=dev->regs[MCP23x17_IOCONB]=val & ~IOCON_BANK_MODE;
+			mcp23x17_update_int(dev);
+			break;
+		case MCP23x17_INTFA:
+		case MCP23x17_INTCAPA:
+			break;
+		case MCP23x17_GPIOA:
+			dev->regs[MCP23x17_OLATA+port]=val;
+			break;
+		default:
+			dev->regs[reg]=val;
+	}
+}
+
+//Called from the wiringPiEmu edges thread when an input pin changes
+void mcp23x17_pin_changed(struct wiringPiNodeStruct *node, int pin, int value, uint64_t tsus) {
+	struct zyni2cemu_dev_st *dev=node->data;
+	uint8_t bit=pin-dev->mcp23x17.base_pin;
+	uint8_t port=bit>>3;
+	uint8_t mask=1<<(bit & 0x7);
+	pthread_mutex_lock(&zyni2cemu_lock);
+	if ((dev->regs[MCP23x17_GPINTENA+port] & mask) && (dev->regs[MCP23x17_IODIRA+port] & mask)) {
+		// interrupt on change or when different from DEFVAL
+		uint8_t level=(value ? mask : 0) ^ (dev->regs[MCP23x17_IPOLA+port] & mask);
+		if (!(dev->regs[MCP23x17_INTCONA+port] & mask) || level!=(dev->regs[MCP23x17_DEFVALA+port] & mask)) {
+			// INTF & INTCAP keep the first change until the interrupt is cleared
+			if (dev->regs[MCP23x17_INTFA+port]==0) {
+				dev->regs[MCP23x17_INTFA+port]=mask;
+				dev->regs[MCP23x17_INTCAPA+port]=mcp23x17_gpio(dev, port);
+				mcp23x17_update_int(dev);
+			}
+		}
+	}
+	pthread_mutex_unlock(&zyni2cemu_lock);
+}
+
+//-----------------------------------------------------------------------------
+// ADS1115
+//-----------------------------------------------------------------------------
+
+#define ADS1115_CONFIG_OS 0x8000
+#define ADS1115_CONFIG_MODE_SINGLE 0x0100
+
+unsigned long ads1115_conversion_us(uint16_t config) {
+	const unsigned int sps[8]={8, 16, 32, 64, 128, 250, 475, 860};
+	return 1000000/sps[(config >> 5) & 0x7];
+}
+
+int16_t ads1115_convert(struct zyni2cemu_dev_st *dev) {
+	const float fsr[8]={6.144, 4.096, 2.048, 1.024, 0.512, 0.256, 0.256, 0.256};
+	uint16_t config=dev->ads1115.conv_config;
+	float *vin=dev->ads1115.vin;
+	float v;
+	uint8_t mux=(config >> 12) & 0x7;
+	switch (mux) {
+		case 0: v=vin[0]-vin[1]; break;
+		case 1: v=vin[0]-vin[3]; break;
+		case 2: v=vin[1]-vin[3]; break;
+		case 3: v=vin[2]-vin[3]; break;
+		default: v=vin[mux-4];
+	}
+	long val=lroundf(v/fsr[(config >> 9) & 0x7]*32768.0);
+	if (val>32767) val=32767;
+	else if (val<-32768) val=-32768;
+	return (int16_t)val;
+}
+
+//The conversion register changes when the running conversion ends. The next one
+//starts at the same time, with the current settings (continuous mode).
+void ads1115_update(struct zyni2cemu_dev_st *dev) {
+	unsigned long tsus=zyni2cemu_get_tsus();
+	while (dev->ads1115.converting) {
+		unsigned long conv_us=ads1115_conversion_us(dev->ads1115.conv_config);
+		long elapsed=(long)(tsus-dev->ads1115.conv_tsus);
+		if (elapsed<(long)conv_us) return;
+		dev->ads1115.conversion=ads1115_convert(dev);
+		dev->ads1115.conv_tsus+=conv_us;
+		if (dev->ads1115.config & ADS1115_CONFIG_MODE_SINGLE) {
+			if (!dev->ads1115.start_pending) {
+				dev->ads1115.converting=0;
+				dev->ads1115.config|=ADS1115_CONFIG_OS;
+				return;
+			}
+			dev->ads1115.start_pending=0;
+		}
+		//Settings changed during the conversion are used from now on
+		if (dev->ads1115.conv_config!=dev->ads1115.config) {
+			dev->ads1115.conv_config=dev->ads1115.config;
+			continue;
+		}
+		//Skip the conversions that nobody read, but the last one
+		if (!(dev->ads1115.config & ADS1115_CONFIG_MODE_SINGLE) && elapsed>=(long)(3*conv_us)) {
+			dev->ads1115.conv_tsus+=(elapsed/conv_us - 2)*conv_us;
+		}
+	}
+}
+
+uint16_t ads1115_read(struct zyni2cemu_dev_st *dev, uint8_t reg) {
+	ads1115_update(dev);
+	switch (reg) {
+		case 0: return dev->ads1115.conversion;
+		case 1: return dev->ads1115.config;
+		case 2: return dev->ads1115.lo_thresh;
+	}
+	return dev->ads1115.hi_thresh;
+}
+
+void ads1115_write(struct zyni2cemu_dev_st *dev, uint8_t reg, uint16_t val) {
+	switch (reg) {
+		case 0:
+			break;
+		case 1:
+			ads1115_update(dev);
+			// running conversion => it's finished with the previous settings
+			if (dev->ads1115.converting) {
+				if ((val & ADS1115_CONFIG_MODE_SINGLE) && (val & ADS1115_CONFIG_OS)) dev->ads1115.start_pending=1;
+				val&=~ADS1115_CONFIG_OS;
+			} else if (!(val & ADS1115_CONFIG_MODE_SINGLE) || (val & ADS1115_CONFIG_OS)) {
+				dev->ads1115.converting=1;
+				dev->ads1115.conv_tsus=zyni2cemu_get_tsus();
+				dev->ads1115.conv_config=val;
+				val&=~ADS1115_CONFIG_OS;
+			} else {
+				val|=dev->ads1115.config & ADS1115_CONFIG_OS;
+			}
+			dev->ads1115.config=val;
+			break;
+		case 2:
+			dev->ads1115.lo_thresh=val;
+			break;
+		default:
+			dev->ads1115.hi_thresh=val;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// MCP4728
+//-----------------------------------------------------------------------------
+
+//hi => VREF, PD1, PD0, GAIN, D11-D8
+void mcp4728_set_dac(struct zyni2cemu_dev_st *dev, uint8_t ch, uint8_t hi, uint8_t lo) {
+	dev->mcp4728.cfg[ch & 0x3]=hi & 0xF0;
+	dev->mcp4728.dac[ch & 0x3]=((hi & 0x0F) << 8) | lo;
+}
+
+void mcp4728_write(struct zyni2cemu_dev_st *dev, uint8_t *buf, int len) {
+	int i;
+	uint8_t ch, cmd=buf[0];
+	if ((cmd & 0xC0)==0x00) {
+		// fast write => PD1, PD0, D11-D8 & D7-D0 for channels A-D
+		for (ch=0;ch<4 && 2*ch+1<len;ch++) {
+			uint8_t cfg=(dev->mcp4728.cfg[ch] & 0x90) | ((buf[2*ch] & 0x30) << 1);
+			mcp4728_set_dac(dev, ch, cfg | (buf[2*ch] & 0x0F), buf[2*ch+1]);
+		}
+	} else if ((cmd & 0xF8)==0x40) {
+		// multi-write => (command, hi, lo) for every channel
+		for (i=0;i+2<len;i+=3) mcp4728_set_dac(dev, buf[i] >> 1, buf[i+1], buf[i+2]);
+	} else if ((cmd & 0xF8)==0x50) {
+		// sequential write => from the channel in command to D (EEPROM is not emulated)
+		for (ch=(cmd >> 1) & 0x3, i=1;ch<4 && i+1<len;ch++, i+=2) mcp4728_set_dac(dev, ch, buf[i], buf[i+1]);
+	} else if ((cmd & 0xF8)==0x58) {
+		// single write
+		if (len>=3) mcp4728_set_dac(dev, cmd >> 1, buf[1], buf[2]);
+	} else if ((cmd & 0xF0)==0x80) {
+		// VREF select
+		for (ch=0;ch<4;ch++) dev->mcp4728.cfg[ch]=(dev->mcp4728.cfg[ch] & ~0x80) | (((cmd >> (3-ch)) & 0x1) << 7);
+	} else if ((cmd & 0xF0)==0xC0) {
+		// gain select
+		for (ch=0;ch<4;ch++) dev->mcp4728.cfg[ch]=(dev->mcp4728.cfg[ch] & ~0x10) | (((cmd >> (3-ch)) & 0x1) << 4);
+	}
+}
+
+//DAC & EEPROM registers for channels A-D => 24 bytes
+void mcp4728_read(struct zyni2cemu_dev_st *dev, uint8_t *buf, int len) {
+	int i;
+	for (i=0;i<len;i++) {
+		uint8_t ch=(i / 6) & 0x3;
+		switch (i % 3) {
+			case 0: buf[i]=0x80 | (ch << 4) | (dev->addr & 0x7); break;	// RDY, channel & address
+			case 1: buf[i]=dev->mcp4728.cfg[ch] | (dev->mcp4728.dac[ch] >> 8); break;
+			default: buf[i]=dev->mcp4728.dac[ch] & 0xFF;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// VL53L0X
+//-----------------------------------------------------------------------------
+
+#define VL53L0X_REG_SYSRANGE_START 0x00
+#define VL53L0X_REG_SYSTEM_INTERRUPT_CLEAR 0x0B
+#define VL53L0X_REG_RESULT_INTERRUPT_STATUS 0x13
+#define VL53L0X_REG_RESULT_RANGE_STATUS 0x14
+
+//Samples are taken every VL53L0X_SAMPLE_US in back-to-back mode, or once in single-shot mode
+void vl53l0x_update(struct zyni2cemu_dev_st *dev) {
+	if (!dev->vl53l0x.running) return;
+	unsigned long tsus=zyni2cemu_get_tsus();
+	if ((long)(tsus-dev->vl53l0x.sample_tsus)<0) return;
+	dev->regs[VL53L0X_REG_RESULT_INTERRUPT_STATUS]=0x04;	// new sample ready
+	dev->regs[VL53L0X_REG_RESULT_RANGE_STATUS]=0x58;		// range valid
+	dev->regs[VL53L0X_REG_RESULT_RANGE_STATUS+10]=dev->vl53l0x.range_mm >> 8;
+	dev->regs[VL53L0X_REG_RESULT_RANGE_STATUS+11]=dev->vl53l0x.range_mm & 0xFF;
+	if (dev->vl53l0x.running & 0x02) {
+		while ((long)(tsus-dev->vl53l0x.sample_tsus)>=0) dev->vl53l0x.sample_tsus+=VL53L0X_SAMPLE_US;
+	} else {
+		dev->vl53l0x.running=0;
+	}
+}
+
+void vl53l0x_write(struct zyni2cemu_dev_st *dev, uint8_t reg, uint8_t val) {
+	// register 0x00 is SYSRANGE_START only in page 0 (0xFF => page select)
+	if (reg==VL53L0X_REG_SYSRANGE_START && dev->regs[0xFF]==0) {
+		dev->vl53l0x.running=val & 0x03;
+		dev->vl53l0x.sample_tsus=zyni2cemu_get_tsus() + VL53L0X_SAMPLE_US;
+	} else if (reg==VL53L0X_REG_SYSTEM_INTERRUPT_CLEAR) {
+		dev->regs[VL53L0X_REG_RESULT_INTERRUPT_STATUS]=0;
+	} else {
+		dev->regs[reg]=val;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// riban HWC
+//-----------------------------------------------------------------------------
+
+void hwc_update_int(struct zyni2cemu_dev_st *dev) {
+	zyni2cemu_set_pin(dev->hwc.int_pin, &dev->hwc.int_level, dev->hwc.queue_len==0);
+}
+
+void hwc_queue(struct zyni2cemu_dev_st *dev, uint8_t reg) {
+	if (reg==0 || dev->hwc.queued[reg]) return;
+	dev->hwc.queued[reg]=1;
+	dev->hwc.queue[dev->hwc.queue_len++]=reg;
+}
+
+void hwc_dequeue(struct zyni2cemu_dev_st *dev, uint8_t reg) {
+	int i;
+	if (!dev->hwc.queued[reg]) return;
+	dev->hwc.queued[reg]=0;
+	for (i=0;i<dev->hwc.queue_len;i++) {
+		if (dev->hwc.queue[i]==reg) {
+			memmove(dev->hwc.queue+i, dev->hwc.queue+i+1, dev->hwc.queue_len-i-1);
+			dev->hwc.queue_len--;
+			break;
+		}
+	}
+}
+
+//Read a control value (little-endian) => it's not changed anymore
+int16_t hwc_read_value(struct zyni2cemu_dev_st *dev, uint8_t reg) {
+	int16_t val=dev->hwc.values[reg];
+	if (dev->hwc.relative[reg]) dev->hwc.values[reg]=0;
+	hwc_dequeue(dev, reg);
+	return val;
+}
+
+void hwc_read(struct zyni2cemu_dev_st *dev, uint8_t *buf, int len, int ptr_set) {
+	int i;
+	int16_t val;
+	memset(buf, 0, len);
+	if (!ptr_set) {
+		// register 0 => next changed control
+		if (dev->hwc.queue_len>0) memset(buf, dev->hwc.queue[0], len);
+	} else if (dev->ptr==HWC_REG_BULK) {
+		// bulk readout => [count, (reg, LSB, MSB) x count]
+		int count=(len-1)/3;
+		if (count>dev->hwc.queue_len) count=dev->hwc.queue_len;
+		for (i=0;i<count;i++) {
+			uint8_t reg=dev->hwc.queue[0];
+			val=hwc_read_value(dev, reg);
+			buf[1+3*i]=reg;
+			buf[2+3*i]=val & 0xFF;
+			buf[3+3*i]=(val >> 8) & 0xFF;
+		}
+		if (len>0) buf[0]=count | (dev->hwc.queue_len>0 ? HWC_BULK_MORE : 0);
+	} else {
+		val=hwc_read_value(dev, dev->ptr);
+		buf[0]=val & 0xFF;
+		if (len>1) buf[1]=(val >> 8) & 0xFF;
+	}
+	hwc_update_int(dev);
+}
+
+void hwc_write(struct zyni2cemu_dev_st *dev, uint8_t *buf, int len) {
+	dev->ptr=buf[0];
+	// writing register 0 resets the HWC => changes are discarded
+	if (dev->ptr==0 && len>1) {
+		while (dev->hwc.queue_len>0) hwc_dequeue(dev, dev->hwc.queue[0]);
+		memset(dev->hwc.values, 0, sizeof(dev->hwc.values));
+		hwc_update_int(dev);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Device access
+//-----------------------------------------------------------------------------
+
+void zyni2cemu_write(struct zyni2cemu_dev_st *dev, uint8_t *buf, int len) {
+	int i;
+	if (len<1) return;
+	switch (dev->type) {
+		case ZYNI2CEMU_MCP23008:
+		case ZYNI2CEMU_MCP23017:
+			dev->ptr=buf[0];
+			for (i=1;i<len;i++) {
+				mcp23x17_write(dev, mcp23x17_reg(dev, dev->ptr), buf[i]);
+				dev->ptr=mcp23x17_next_ptr(dev, dev->ptr);
+			}
+			break;
+		case ZYNI2CEMU_ADS1115:
+			dev->ptr=buf[0] & 0x3;
+			if (len>=3) ads1115_write(dev, dev->ptr, (buf[1] << 8) | buf[2]);
+			break;
+		case ZYNI2CEMU_MCP4728:
+			mcp4728_write(dev, buf, len);
+			break;
+		case ZYNI2CEMU_TCA954X:
+			// last byte is the control register
+			dev->tca954x.control=buf[len-1];
+			break;
+		case ZYNI2CEMU_VL53L0X:
+			dev->ptr=buf[0];
+			for (i=1;i<len;i++) vl53l0x_write(dev, dev->ptr++, buf[i]);
+			break;
+		case ZYNI2CEMU_HWC:
+			hwc_write(dev, buf, len);
+			break;
+	}
+}
+
+void zyni2cemu_read(struct zyni2cemu_dev_st *dev, uint8_t *buf, int len, int ptr_set) {
+	int i;
+	uint16_t val=0;
+	switch (dev->type) {
+		case ZYNI2CEMU_MCP23008:
+		case ZYNI2CEMU_MCP23017:
+			for (i=0;i<len;i++) {
+				buf[i]=mcp23x17_read(dev, mcp23x17_reg(dev, dev->ptr));
+				dev->ptr=mcp23x17_next_ptr(dev, dev->ptr);
+			}
+			break;
+		case ZYNI2CEMU_ADS1115:
+			// 16 bits registers, MSB first
+			for (i=0;i<len;i++) {
+				if ((i & 0x1)==0) val=ads1115_read(dev, dev->ptr);
+				buf[i]=(i & 0x1) ? val & 0xFF : val >> 8;
+			}
+			break;
+		case ZYNI2CEMU_MCP4728:
+			mcp4728_read(dev, buf, len);
+			break;
+		case ZYNI2CEMU_TCA954X:
+			memset(buf, dev->tca954x.control, len);
+			break;
+		case ZYNI2CEMU_VL53L0X:
+			vl53l0x_update(dev);
+			for (i=0;i<len;i++) buf[i]=dev->regs[dev->ptr++];
+			break;
+		case ZYNI2CEMU_HWC:
+			hwc_read(dev, buf, len, ptr_set);
+			break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Devices
+//-----------------------------------------------------------------------------
+
+struct zyni2cemu_dev_st *get_zyni2cemu_device(uint8_t addr, int8_t mux_chan) {
+	int i;
+	for (i=0;i<ZYNI2CEMU_MAX_DEVICES;i++) {
+		struct zyni2cemu_dev_st *dev=zyni2cemu_devs+i;
+		if (dev->enabled && dev->addr==addr && dev->mux_chan==mux_chan) return dev;
+	}
+	return NULL;
+}
+
+struct zyni2cemu_dev_st *add_zyni2cemu_device(enum zyni2cemu_type_enum type, uint8_t addr, int8_t mux_chan) {
+	int i;
+	if (get_zyni2cemu_device(addr, mux_chan)) {
+		fprintf(stderr, "ZynI2CEmu: Device address 0x%02x (mux channel %d) is already in use.\n", addr, mux_chan);
+		return NULL;
+	}
+	for (i=0;i<ZYNI2CEMU_MAX_DEVICES;i++) {
+		struct zyni2cemu_dev_st *dev=zyni2cemu_devs+i;
+		if (dev->enabled) continue;
+		pthread_mutex_lock(&zyni2cemu_lock);
+		memset(dev, 0, sizeof(struct zyni2cemu_dev_st));
+		dev->type=type;
+		dev->addr=addr;
+		dev->mux_chan=mux_chan;
+		// power-on values
+		switch (type) {
+			case ZYNI2CEMU_MCP23008:
+			case ZYNI2CEMU_MCP23017:
+				dev->regs[MCP23x17_IODIRA]=dev->regs[MCP23x17_IODIRB]=0xFF;
+				dev->mcp23x17.int_pins[0]=dev->mcp23x17.int_pins[1]=-1;
+				break;
+			case ZYNI2CEMU_ADS1115:
+				dev->ads1115.config=0x8583;
+				dev->ads1115.lo_thresh=0x8000;
+				dev->ads1115.hi_thresh=0x7FFF;
+				break;
+			case ZYNI2CEMU_TCA954X:
+				zyni2cemu_mux=dev;
+				break;
+			case ZYNI2CEMU_VL53L0X:
+				dev->regs[0xC0]=0xEE;		// model ID
+				dev->regs[0xC1]=0xAA;
+				dev->regs[0xC2]=0x10;		// revision ID
+				dev->regs[0x84]=0x01;		// GPIO_HV_MUX_ACTIVE_HIGH
+				dev->regs[0x91]=0x3C;		// stop variable
+				dev->vl53l0x.range_mm=8190;	// out of range
+				break;
+			case ZYNI2CEMU_HWC:
+				dev->hwc.int_pin=-1;
+				break;
+			default:
+				break;
+		}
+		dev->enabled=1;
+		pthread_mutex_unlock(&zyni2cemu_lock);
+		return dev;
+	}
+	fprintf(stderr, "ZynI2CEmu: Maximum number of devices exceeded: %d\n", ZYNI2CEMU_MAX_DEVICES);
+	return NULL;
+}
+
+struct zyni2cemu_dev_st *add_zyni2cemu_mcp23x17(uint8_t addr, uint8_t num_pins, uint16_t base_pin, int16_t inta_pin, int16_t intb_pin) {
+	struct zyni2cemu_dev_st *dev=add_zyni2cemu_device(num_pins==8 ? ZYNI2CEMU_MCP23008 : ZYNI2CEMU_MCP23017, addr, -1);
+	if (!dev) return NULL;
+	struct wiringPiNodeStruct *node=wiringPiFindNode(base_pin);
+	if (!node) node=wiringPiNewNode(base_pin, num_pins);
+	if (!node) {
+		dev->enabled=0;
+		return NULL;
+	}
+	node->fd=addr;
+	node->data=dev;
+	node->pinChanged=mcp23x17_pin_changed;
+	dev->mcp23x17.base_pin=base_pin;
+	dev->mcp23x17.num_pins=num_pins;
+	dev->mcp23x17.int_pins[0]=inta_pin;
+	dev->mcp23x17.int_pins[1]=num_pins==8 ? -1 : intb_pin;
+	// INT outputs are active low after power-on
+	int p;
+	for (p=0;p<2;p++) {
+		dev->mcp23x17.int_levels[p]=1;
+		if (dev->mcp23x17.int_pins[p]>=0) digitalWrite(dev->mcp23x17.int_pins[p], 1);
+	}
+	return dev;
+}
+
+struct zyni2cemu_dev_st *add_zyni2cemu_hwc(uint8_t addr, int16_t int_pin) {
+	struct zyni2cemu_dev_st *dev=add_zyni2cemu_device(ZYNI2CEMU_HWC, addr, -1);
+	if (!dev) return NULL;
+	dev->hwc.int_pin=int_pin;
+	dev->hwc.int_level=1;
+	if (int_pin>=0) digitalWrite(int_pin, 1);
+	return dev;
+}
+
+struct zyni2cemu_dev_st *get_zyni2cemu_device_by_type(enum zyni2cemu_type_enum type) {
+	int i;
+	for (i=0;i<ZYNI2CEMU_MAX_DEVICES;i++) {
+		if (zyni2cemu_devs[i].enabled && zyni2cemu_devs[i].type==type) return zyni2cemu_devs+i;
+	}
+	return NULL;
+}
+
+void set_zyni2cemu_ads1115_vin(uint8_t addr, uint8_t ch, float vin) {
+	struct zyni2cemu_dev_st *dev=get_zyni2cemu_device(addr, -1);
+	if (!dev || dev->type!=ZYNI2CEMU_ADS1115) return;
+	pthread_mutex_lock(&zyni2cemu_lock);
+	dev->ads1115.vin[ch & 0x3]=vin;
+	pthread_mutex_unlock(&zyni2cemu_lock);
+}
+
+void set_zyni2cemu_vl53l0x_range(int8_t mux_chan, uint16_t range_mm) {
+	struct zyni2cemu_dev_st *dev=get_zyni2cemu_device(VL53L0X_I2C_ADDRESS, mux_chan);
+	if (!dev || dev->type!=ZYNI2CEMU_VL53L0X) return;
+	pthread_mutex_lock(&zyni2cemu_lock);
+	dev->vl53l0x.range_mm=range_mm;
+	pthread_mutex_unlock(&zyni2cemu_lock);
+}
+
+uint16_t get_zyni2cemu_mcp4728_dac(uint8_t addr, uint8_t ch) {
+	struct zyni2cemu_dev_st *dev=get_zyni2cemu_device(addr, -1);
+	if (!dev || dev->type!=ZYNI2CEMU_MCP4728) return 0;
+	return dev->mcp4728.dac[ch & 0x3];
+}
+
+void set_zyni2cemu_hwc_value(uint8_t reg, int16_t value) {
+	struct zyni2cemu_dev_st *dev=get_zyni2cemu_device_by_type(ZYNI2CEMU_HWC);
+	if (!dev) return;
+	pthread_mutex_lock(&zyni2cemu_lock);
+	dev->hwc.values[reg]=value;
+	dev->hwc.relative[reg]=0;
+	hwc_queue(dev, reg);
+	hwc_update_int(dev);
+	pthread_mutex_unlock(&zyni2cemu_lock);
+}
+
+void add_zyni2cemu_hwc_delta(uint8_t reg, int16_t delta) {
+	struct zyni2cemu_dev_st *dev=get_zyni2cemu_device_by_type(ZYNI2CEMU_HWC);
+	if (!dev) return;
+	pthread_mutex_lock(&zyni2cemu_lock);
+	if (!dev->hwc.relative[reg]) dev->hwc.values[reg]=0;
+	dev->hwc.values[reg]+=delta;
+	dev->hwc.relative[reg]=1;
+	hwc_queue(dev, reg);
+	hwc_update_int(dev);
+	pthread_mutex_unlock(&zyni2cemu_lock);
+}
+
+//-----------------------------------------------------------------------------
+// Emulated device libraries (MCP4728 & tof), over the emulated bus
+//-----------------------------------------------------------------------------
+
+//The real libraries use their own fd and they are called from the bus thread
+//(zyni2c_call), so the emulated ones access the bus directly too.
+int zyni2cemu_write_data(uint8_t addr, uint8_t *data, uint8_t len) {
+	struct i2c_msg msg;
+	msg.addr=addr;
+	msg.flags=0;
+	msg.len=len;
+	msg.buf=data;
+	return zyni2cemu_rdwr(&msg, 1);
+}
+
+int zyni2cemu_write_reg8(uint8_t addr, uint8_t reg, uint8_t val) {
+	uint8_t data[2]={reg, val};
+	return zyni2cemu_write_data(addr, data, 2);
+}
+
+int zyni2cemu_read_reg8(uint8_t addr, uint8_t reg) {
+	uint8_t val;
+	struct i2c_msg msgs[2];
+	msgs[0].addr=addr;
+	msgs[0].flags=0;
+	msgs[0].len=1;
+	msgs[0].buf=&reg;
+	msgs[1].addr=addr;
+	msgs[1].flags=I2C_M_RD;
+	msgs[1].len=1;
+	msgs[1].buf=&val;
+	if (zyni2cemu_rdwr(msgs, 2)<0) return -1;
+	return val;
+}
+
+struct mcp4728_chip_st {
+	uint8_t addr;
+};
+
+void *mcp4728_initialize(int bus, int ldac_pin, int rdy_pin, int addr) {
+	uint8_t data[24];
+	struct i2c_msg msg;
+	msg.addr=addr;
+	msg.flags=I2C_M_RD;
+	msg.len=sizeof(data);
+	msg.buf=data;
+	if (zyni2cemu_rdwr(&msg, 1)<0) return NULL;
+	struct mcp4728_chip_st *chip=malloc(sizeof(struct mcp4728_chip_st));
+	chip->addr=addr;
+	return chip;
+}
+
+uint16_t mcp4728_code(float vout) {
+	long code=lroundf(vout/ZYNI2CEMU_MCP4728_VDD*4096.0);
+	if (code>4095) code=4095;
+	else if (code<0) code=0;
+	return code;
+}
+
+//External reference (VDD), gain x1 & normal power mode
+int mcp4728_singleexternal(void *chip, int ch, float vout, int eeprom) {
+	if (!chip) return -1;
+	uint16_t code=mcp4728_code(vout);
+	uint8_t data[3]={(eeprom ? 0x58 : 0x40) | ((ch & 0x3) << 1), code >> 8, code & 0xFF};
+	return zyni2cemu_write_data(((struct mcp4728_chip_st *)chip)->addr, data, 3);
+}
+
+//All the channels in a single transaction => multi-write, or sequential write to DAC & EEPROM
+int mcp4728_multipleexternal(void *chip, float *vouts, int eeprom) {
+	if (!chip) return -1;
+	int ch;
+	uint8_t data[12];
+	for (ch=0;ch<4;ch++) {
+		uint16_t code=mcp4728_code(vouts[ch]);
+		if (eeprom) {
+			data[1+2*ch]=code >> 8;
+			data[2+2*ch]=code & 0xFF;
+		} else {
+			data[3*ch]=0x40 | (ch << 1);
+			data[3*ch+1]=code >> 8;
+			data[3*ch+2]=code & 0xFF;
+		}
+	}
+	if (eeprom) {
+		data[0]=0x50;
+		return zyni2cemu_write_data(((struct mcp4728_chip_st *)chip)->addr, data, 9);
+	}
+	return zyni2cemu_write_data(((struct mcp4728_chip_st *)chip)->addr, data, 12);
+}
+
+uint8_t tof_addr=VL53L0X_I2C_ADDRESS;
+
+//Only checks the model & reads the stop variable, as the tof library does at start
+int tofInit(int iChan, int iAddr, int bLongRange) {
+	tof_addr=iAddr;
+	if (zyni2cemu_read_reg8(tof_addr, 0xC0)!=0xEE) return 0;
+	zyni2cemu_write_reg8(tof_addr, 0x88, 0x00);
+	zyni2cemu_write_reg8(tof_addr, 0x80, 0x01);
+	zyni2cemu_write_reg8(tof_addr, 0xFF, 0x01);
+	zyni2cemu_write_reg8(tof_addr, 0x00, 0x00);
+	if (zyni2cemu_read_reg8(tof_addr, 0x91)<0) return 0;
+	zyni2cemu_write_reg8(tof_addr, 0x00, 0x01);
+	zyni2cemu_write_reg8(tof_addr, 0xFF, 0x00);
+	zyni2cemu_write_reg8(tof_addr, 0x80, 0x00);
+	return 1;
+}
+
+int tofGetModel(int *model, int *revision) {
+	*model=zyni2cemu_read_reg8(tof_addr, 0xC0);
+	*revision=zyni2cemu_read_reg8(tof_addr, 0xC2);
+	return *model>=0 && *revision>=0;
+}
+
+//-----------------------------------------------------------------------------
+// Emulated I2C Bus Initialization
+//-----------------------------------------------------------------------------
+
+int init_zyni2cemu() {
+	int i;
+	char *env;
+	if ((env=getenv("ZYNI2CEMU_BUS_HZ"))) zyni2cemu_bus_hz=atoi(env);
+	if ((env=getenv("ZYNI2CEMU_XFER_US"))) zyni2cemu_xfer_us=atoi(env);
+	for (i=0;i<ZYNI2CEMU_MAX_DEVICES;i++) zyni2cemu_devs[i].enabled=0;
+	zyni2cemu_mux=NULL;
+	reset_zyni2cemu_stats();
+
+	// INT lines are driven on the virtual GPIO
+	wiringPiSetup();
+
+#if defined(I2C_HWC)
+	add_zyni2cemu_hwc(HWC_I2C_ADDRESS, HWC_INT_PIN);
+#elif defined(MCP23017_ENCODERS)
+	add_zyni2cemu_mcp23x17(MCP23017_I2C_ADDRESS, 16, EXPANDER_BASE_PIN, MCP23017_INTA_PIN, MCP23017_INTB_PIN);
+#elif defined(MCP23008_ENCODERS)
+	add_zyni2cemu_mcp23x17(MCP23008_I2C_ADDRESS, 8, EXPANDER_BASE_PIN, MCP23008_INT_PIN, -1);
+#endif
+
+#if defined(ZYNAPTIK_CONFIG)
+	if (strstr(ZYNAPTIK_CONFIG, "16xDIO")) {
+		add_zyni2cemu_mcp23x17(ZYNAPTIK_MCP23017_I2C_ADDRESS, 16, ZYNAPTIK_MCP23017_BASE_PIN, ZYNAPTIK_MCP23017_INTA_PIN, ZYNAPTIK_MCP23017_INTB_PIN);
+	}
+	if (strstr(ZYNAPTIK_CONFIG, "4xAD")) {
+		add_zyni2cemu_device(ZYNI2CEMU_ADS1115, ZYNAPTIK_ADS1115_I2C_ADDRESS, -1);
+	}
+	add_zyni2cemu_device(ZYNI2CEMU_MCP4728, ZYNAPTIK_MCP4728_I2C_ADDRESS, -1);
+#endif
+
+#if defined(ZYNTOF_CONFIG)
+	int n=atoi(ZYNTOF_CONFIG);
+	if (n>0) add_zyni2cemu_device(ZYNI2CEMU_TCA954X, TCA954X_I2C_ADDRESS, -1);
+	for (i=0;i<n && i<4;i++) add_zyni2cemu_device(ZYNI2CEMU_VL53L0X, VL53L0X_I2C_ADDRESS, i);
+#endif
+
+	printf("ZynI2CEmu: Emulated I2C bus at %u Hz (%u us per transaction)\n", zyni2cemu_bus_hz, zyni2cemu_xfer_us);
+	return 1;
+}
+
+int end_zyni2cemu() {
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
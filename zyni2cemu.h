@@ -0,0 +1,163 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Emulated I2C Devices
+ *
+ * Userspace I2C bus with register models of the MCP23008/MCP23017
+ * expanders, ADS1115 ADC, MCP4728 DAC, TCA954X multiplexer, VL53L0X
+ * TOF sensor and riban HWC, so the full driver stack can be run and
+ * benchmarked without hardware. The bus timing is configurable and
+ * transactions are counted per device.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdint.h>
+#include <linux/i2c.h>
+
+//-----------------------------------------------------------------------------
+// Emulated I2C Bus
+//-----------------------------------------------------------------------------
+
+#define ZYNI2CEMU_MAX_DEVICES 16
+
+//Default bus timing => SCL frequency & fixed cost per transaction (driver, start/stop, etc.)
+//Can be changed with the ZYNI2CEMU_BUS_HZ & ZYNI2CEMU_XFER_US environment variables.
+//A bus frequency of 0 disables the bus delays.
+#define ZYNI2CEMU_DEFAULT_BUS_HZ 400000
+#define ZYNI2CEMU_DEFAULT_XFER_US 20
+
+enum zyni2cemu_type_enum {
+	ZYNI2CEMU_MCP23008,
+	ZYNI2CEMU_MCP23017,
+	ZYNI2CEMU_ADS1115,
+	ZYNI2CEMU_MCP4728,
+	ZYNI2CEMU_TCA954X,
+	ZYNI2CEMU_VL53L0X,
+	ZYNI2CEMU_HWC
+};
+
+struct zyni2cemu_stats_st {
+	unsigned long xfers;			// bus transactions (I2C_RDWR)
+	unsigned long msgs;				// messages (start or repeated start)
+	unsigned long bytes_read;
+	unsigned long bytes_written;
+	unsigned long bus_us;			// emulated bus time
+};
+
+struct zyni2cemu_dev_st {
+	uint8_t enabled;
+	enum zyni2cemu_type_enum type;
+	uint8_t addr;
+	int8_t mux_chan;				// TCA954X channel, -1 => main bus
+	uint8_t ptr;					// register pointer
+	uint8_t regs[256];
+	union {
+		struct {
+			uint16_t base_pin;		// first pin (wiringPi node)
+			uint8_t num_pins;
+			int16_t int_pins[2];	// INTA, INTB (-1 => not wired)
+			uint8_t int_levels[2];
+		} mcp23x17;
+		struct {
+			float vin[4];			// input voltages
+			uint16_t config;
+			uint16_t lo_thresh;
+			uint16_t hi_thresh;
+			int16_t conversion;
+			uint8_t converting;
+			uint8_t start_pending;	// single-shot requested during a conversion
+			uint16_t conv_config;	// settings of the running conversion
+			unsigned long conv_tsus;	// start of the running conversion
+		} ads1115;
+		struct {
+			uint16_t dac[4];
+			uint8_t cfg[4];			// VREF, PD1, PD0, GAIN (as in the DAC register)
+		} mcp4728;
+		struct {
+			uint8_t control;		// enabled channels
+		} tca954x;
+		struct {
+			uint16_t range_mm;
+			uint8_t running;
+			unsigned long sample_tsus;	// time of next sample
+		} vl53l0x;
+		struct {
+			int16_t values[256];
+			uint8_t relative[256];	// value is a delta, cleared when read
+			uint8_t queued[256];
+			uint8_t queue[256];		// registers with changes, in order
+			uint16_t queue_len;
+			int16_t int_pin;		// active low while there are changes
+			uint8_t int_level;
+		} hwc;
+	};
+	struct zyni2cemu_stats_st stats;
+};
+struct zyni2cemu_dev_st zyni2cemu_devs[ZYNI2CEMU_MAX_DEVICES];
+
+//Whole bus, including transactions to absent devices (NACK)
+struct zyni2cemu_stats_st zyni2cemu_bus_stats;
+unsigned long zyni2cemu_nacks;
+
+//Adds the devices of the configured board (build definitions)
+int init_zyni2cemu();
+int end_zyni2cemu();
+
+//Run an I2C_RDWR transaction => 0 on success, -1 on NACK
+int zyni2cemu_rdwr(struct i2c_msg *msgs, int n);
+
+void set_zyni2cemu_timing(unsigned int bus_hz, unsigned int xfer_us);
+void reset_zyni2cemu_stats();
+//Time source (us) for conversions & samples => NULL for CLOCK_MONOTONIC
+void set_zyni2cemu_clock(unsigned long (*clock)(void));
+
+//-----------------------------------------------------------------------------
+// Devices
+//-----------------------------------------------------------------------------
+
+struct zyni2cemu_dev_st *add_zyni2cemu_device(enum zyni2cemu_type_enum type, uint8_t addr, int8_t mux_chan);
+struct zyni2cemu_dev_st *get_zyni2cemu_device(uint8_t addr, int8_t mux_chan);
+
+//Expander inputs are the wiringPiEmu pins from base_pin, INT outputs are driven on int pins
+struct zyni2cemu_dev_st *add_zyni2cemu_mcp23x17(uint8_t addr, uint8_t num_pins, uint16_t base_pin, int16_t inta_pin, int16_t intb_pin);
+struct zyni2cemu_dev_st *add_zyni2cemu_hwc(uint8_t addr, int16_t int_pin);
+
+//Inputs & outputs
+void set_zyni2cemu_ads1115_vin(uint8_t addr, uint8_t ch, float vin);
+void set_zyni2cemu_vl53l0x_range(int8_t mux_chan, uint16_t range_mm);
+uint16_t get_zyni2cemu_mcp4728_dac(uint8_t addr, uint8_t ch);
+//HWC controls => absolute values (switches, pots) or deltas (encoders)
+void set_zyni2cemu_hwc_value(uint8_t reg, int16_t value);
+void add_zyni2cemu_hwc_delta(uint8_t reg, int16_t delta);
+
+//-----------------------------------------------------------------------------
+// Emulated device libraries (MCP4728 & tof), over the emulated bus
+//-----------------------------------------------------------------------------
+
+//MCP4728 external reference (VDD)
+#define ZYNI2CEMU_MCP4728_VDD 5.0
+
+void *mcp4728_initialize(int bus, int ldac_pin, int rdy_pin, int addr);
+int mcp4728_singleexternal(void *chip, int ch, float vout, int eeprom);
+int mcp4728_multipleexternal(void *chip, float *vouts, int eeprom);
+
+int tofInit(int iChan, int iAddr, int bLongRange);
+int tofGetModel(int *model, int *revision);
+
+//-----------------------------------------------------------------------------
@@ -103,6 +103,11 @@ int zynmaster_jack_process(jack_nframes_t nframes, void *arg) {
 		}
 	}
 
+	#ifdef ZYNAPTIK_CONFIG
+	//Wake up the CV-OUT worker if events were queued
+	zynaptik_cvout_notify();
+	#endif
+
 	return 0;
 }
 
@@ -28,6 +28,8 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
@@ -81,6 +83,7 @@ int init_midi_router() {
 		midi_filter.noterange[i].octave_trans=0;
 		midi_filter.noterange[i].halftone_trans=0;
 		midi_filter.last_pb_val[i]=8192;
+		reset_midi_filter_zones(i);
 	}
 	for (i=0;i<8;i++) {
 		for (j=0;j<16;j++) {
@@ -98,9 +101,13 @@ int init_midi_router() {
 			midi_filter.cc_swap[i][j].num=j;
 		}
 	}
-	memset(midi_filter.ctrl_mode, 0, 16*128);
-	memset(midi_filter.ctrl_relmode_count, 0, 16*128);
+	reset_midi_filter_event_fanouts();
+	reset_midi_filter_cc_luts();
+	reset_midi_filter_chan_state(-1);
 	memset(midi_filter.last_ctrl_val, 0, 16*128);
+	memset(midi_filter.cc_detect, 0, sizeof(midi_filter.cc_detect));
+	midi_filter.cc_detect_n_held=0;
+	reset_midi_filter_cc_modes();
 	memset(midi_filter.note_state, 0, 16*128);
 
 	return 1;
@@ -340,6 +347,100 @@ void reset_midi_filter_note_range(uint8_t chan) {
 	midi_filter.noterange[chan].halftone_trans=0;
 }
 
+//Compiled lookup tables (zones, fan-out) are double buffered: the copy not in use is rebuilt
+//and published with an atomic index store. The old copy is not written again until the jack
+//cycle that could be reading it has ended, so the jack thread never sees a half-built table.
+pthread_mutex_t midi_filter_compile_lock=PTHREAD_MUTEX_INITIALIZER;
+//Odd while a jack cycle is running
+unsigned int jack_cycle_seq=0;
+
+void midi_filter_publish(int *index, int i) {
+	__atomic_store_n(index, i, __ATOMIC_SEQ_CST);
+	unsigned int seq=__atomic_load_n(&jack_cycle_seq, __ATOMIC_SEQ_CST);
+	if (!(seq & 0x1)) return;
+	while (__atomic_load_n(&jack_cycle_seq, __ATOMIC_SEQ_CST)==seq) usleep(100);
+}
+
+//MIDI Keyboard Zones
+
+//Compile the zones of all channels into the note lookup copy not in use & publish it
+void compile_midi_filter_zones() {
+	int chan, i, note, n;
+	pthread_mutex_lock(&midi_filter_compile_lock);
+	int im=midi_filter.zone_map_i ^ 0x1;
+	struct mf_zone_map_st *map=midi_filter.zone_maps+im;
+	for (chan=0; chan<16; chan++) {
+		map->enabled[chan]=0;
+		for (note=0; note<128; note++) {
+			n=0;
+			for (i=0; i<MAX_NUM_ZONES; i++) {
+				struct mf_zone_st *zone=&midi_filter.zones[chan][i];
+				if (!zone->enabled) continue;
+				map->enabled[chan]=1;
+				if (note<zone->note_low || note>zone->note_high) continue;
+				int note_to=note+zone->transpose;
+				if (note_to<0 || note_to>127) continue;
+				map->targets[chan][note][n].chan=zone->chan_to;
+				map->targets[chan][note][n].note=note_to;
+				n++;
+			}
+			map->count[chan][note]=n;
+		}
+	}
+	midi_filter_publish(&midi_filter.zone_map_i, im);
+	pthread_mutex_unlock(&midi_filter_compile_lock);
+}
+
+int set_midi_filter_zone(uint8_t chan, uint8_t iz, uint8_t note_low, uint8_t note_high, uint8_t chan_to, int8_t transpose) {
+	if (chan>15 || chan_to>15) {
+		fprintf(stderr, "ZynMidiRouter: MIDI zone chan (%d => %d) is out of range!\n",chan,chan_to);
+		return 0;
+	}
+	if (iz>=MAX_NUM_ZONES) {
+		fprintf(stderr, "ZynMidiRouter: MIDI zone index (%d) is out of range!\n",iz);
+		return 0;
+	}
+	struct mf_zone_st *zone=&midi_filter.zones[chan][iz];
+	zone->note_low=note_low & 0x7F;
+	zone->note_high=note_high & 0x7F;
+	zone->chan_to=chan_to;
+	zone->transpose=transpose;
+	zone->enabled=1;
+	compile_midi_filter_zones();
+	return 1;
+}
+
+int del_midi_filter_zone(uint8_t chan, uint8_t iz) {
+	if (chan>15) {
+		fprintf(stderr, "ZynMidiRouter: MIDI zone chan (%d) is out of range!\n",chan);
+		return 0;
+	}
+	if (iz>=MAX_NUM_ZONES) {
+		fprintf(stderr, "ZynMidiRouter: MIDI zone index (%d) is out of range!\n",iz);
+		return 0;
+	}
+	midi_filter.zones[chan][iz].enabled=0;
+	compile_midi_filter_zones();
+	return 1;
+}
+
+struct mf_zone_st *get_midi_filter_zone(uint8_t chan, uint8_t iz) {
+	if (chan>15 || iz>=MAX_NUM_ZONES) {
+		fprintf(stderr, "ZynMidiRouter: MIDI zone (%d, %d) is out of range!\n",chan,iz);
+		return NULL;
+	}
+	return &midi_filter.zones[chan][iz];
+}
+
+void reset_midi_filter_zones(uint8_t chan) {
+	if (chan>15) {
+		fprintf(stderr, "ZynMidiRouter: MIDI zone chan (%d) is out of range!\n",chan);
+		return;
+	}
+	memset(midi_filter.zones[chan], 0, sizeof(midi_filter.zones[chan]));
+	compile_midi_filter_zones();
+}
+
 //Core MIDI filter functions
 
 int validate_midi_event(struct midi_event_st *ev) {
@@ -423,6 +524,117 @@ void reset_midi_filter_event_map() {
 	}
 }
 
+//Event fan-out
+
+int validate_fanout_event(struct midi_event_st *ev) {
+	if (ev->type<NOTE_OFF || ev->type>PITCH_BENDING) {
+		fprintf(stderr, "ZynMidiRouter: MIDI Fan-out event type (%d) is not a channel event!\n",ev->type);
+		return 0;
+	}
+	return validate_midi_event(ev);
+}
+
+//Compile the fan-outs into the destination lists copy not in use & publish it
+void compile_midi_filter_event_fanouts() {
+	int i, j, n=0;
+	pthread_mutex_lock(&midi_filter_compile_lock);
+	int im=midi_filter.fanout_map_i ^ 0x1;
+	struct mf_fanout_map_st *map=midi_filter.fanout_maps+im;
+	memset(map->count, 0, sizeof(map->count));
+	for (i=0; i<MAX_NUM_FANOUTS; i++) {
+		struct mf_fanout_st *fanout=midi_filter.fanouts+i;
+		if (!fanout->enabled) continue;
+		struct midi_event_st *from=&fanout->from;
+		//Already compiled with a previous fan-out from the same source
+		if (map->count[from->type & 0x7][from->chan][from->num]>0) continue;
+		map->first[from->type & 0x7][from->chan][from->num]=n;
+		for (j=i; j<MAX_NUM_FANOUTS; j++) {
+			struct mf_fanout_st *f=midi_filter.fanouts+j;
+			if (!f->enabled || f->from.type!=from->type || f->from.chan!=from->chan || f->from.num!=from->num) continue;
+			map->dests[n].status=(f->to.type << 4) | f->to.chan;
+			map->dests[n].num=f->to.num;
+			map->dests[n].val_lut=f->val_lut;
+			n++;
+		}
+		map->count[from->type & 0x7][from->chan][from->num]=n-map->first[from->type & 0x7][from->chan][from->num];
+	}
+	midi_filter_publish(&midi_filter.fanout_map_i, im);
+	pthread_mutex_unlock(&midi_filter_compile_lock);
+}
+
+int add_midi_filter_event_fanout(enum midi_event_type_enum type_from, uint8_t chan_from, uint8_t num_from, enum midi_event_type_enum type_to, uint8_t chan_to, uint8_t num_to) {
+	struct midi_event_st ev_from={ .type=type_from, .chan=chan_from, .num=num_from };
+	struct midi_event_st ev_to={ .type=type_to, .chan=chan_to, .num=num_to };
+	if (!validate_fanout_event(&ev_from) || !validate_fanout_event(&ev_to)) return -1;
+	int i, j;
+	for (i=0; i<MAX_NUM_FANOUTS; i++) {
+		if (!midi_filter.fanouts[i].enabled) break;
+	}
+	if (i>=MAX_NUM_FANOUTS) {
+		fprintf(stderr, "ZynMidiRouter: Too many MIDI fan-outs (%d)!\n",MAX_NUM_FANOUTS);
+		return -1;
+	}
+	struct mf_fanout_st *fanout=midi_filter.fanouts+i;
+	fanout->from=ev_from;
+	fanout->to=ev_to;
+	for (j=0; j<128; j++) fanout->val_lut[j]=j;
+	fanout->enabled=1;
+	compile_midi_filter_event_fanouts();
+	return i;
+}
+
+int set_midi_filter_event_fanout_lut(int i, uint8_t lut[128]) {
+	if (i<0 || i>=MAX_NUM_FANOUTS || !midi_filter.fanouts[i].enabled) {
+		fprintf(stderr, "ZynMidiRouter: Bad MIDI fan-out index (%d)!\n",i);
+		return 0;
+	}
+	int j;
+	for (j=0; j<128; j++) {
+		midi_filter.fanouts[i].val_lut[j]=lut[j] & 0x7F;
+	}
+	return 1;
+}
+
+uint8_t *get_midi_filter_event_fanout_lut(int i) {
+	if (i<0 || i>=MAX_NUM_FANOUTS) {
+		fprintf(stderr, "ZynMidiRouter: Bad MIDI fan-out index (%d)!\n",i);
+		return NULL;
+	}
+	return midi_filter.fanouts[i].val_lut;
+}
+
+struct mf_fanout_st *get_midi_filter_event_fanout(int i) {
+	if (i<0 || i>=MAX_NUM_FANOUTS) {
+		fprintf(stderr, "ZynMidiRouter: Bad MIDI fan-out index (%d)!\n",i);
+		return NULL;
+	}
+	return midi_filter.fanouts+i;
+}
+
+int del_midi_filter_event_fanout(int i) {
+	if (i<0 || i>=MAX_NUM_FANOUTS) {
+		fprintf(stderr, "ZynMidiRouter: Bad MIDI fan-out index (%d)!\n",i);
+		return 0;
+	}
+	midi_filter.fanouts[i].enabled=0;
+	compile_midi_filter_event_fanouts();
+	return 1;
+}
+
+void del_midi_filter_event_fanouts(enum midi_event_type_enum type_from, uint8_t chan_from, uint8_t num_from) {
+	int i;
+	for (i=0; i<MAX_NUM_FANOUTS; i++) {
+		struct mf_fanout_st *fanout=midi_filter.fanouts+i;
+		if (fanout->from.type==type_from && fanout->from.chan==chan_from && fanout->from.num==num_from) fanout->enabled=0;
+	}
+	compile_midi_filter_event_fanouts();
+}
+
+void reset_midi_filter_event_fanouts() {
+	memset(midi_filter.fanouts, 0, sizeof(midi_filter.fanouts));
+	compile_midi_filter_event_fanouts();
+}
+
 //Simple CC mapping
 
 void set_midi_filter_cc_map(uint8_t chan_from, uint8_t cc_from, uint8_t chan_to, uint8_t cc_to) {
@@ -452,9 +664,307 @@ void reset_midi_filter_cc_map() {
 	}
 }
 
+//CC value transform
+
+void set_midi_filter_cc_lut(uint8_t chan, uint8_t cc, uint8_t lut[128]) {
+	if (chan>15 || cc>127) {
+		fprintf(stderr, "ZynMidiRouter: MIDI CC LUT (%d, %d) is out of range!\n",chan,cc);
+		return;
+	}
+	int i;
+	for (i=0; i<128; i++) {
+		midi_filter.cc_val_lut[chan][cc][i]=lut[i] & 0x7F;
+	}
+}
+
+void set_midi_filter_cc_curve(uint8_t chan, uint8_t cc, uint8_t val_min, uint8_t val_max, float curve) {
+	if (chan>15 || cc>127) {
+		fprintf(stderr, "ZynMidiRouter: MIDI CC LUT (%d, %d) is out of range!\n",chan,cc);
+		return;
+	}
+	if (curve<=0) curve=1.0;
+	int i;
+	for (i=0; i<128; i++) {
+		float x=powf(i/127.0, curve);
+		midi_filter.cc_val_lut[chan][cc][i]=(uint8_t)lroundf(val_min + x*((int)val_max-(int)val_min)) & 0x7F;
+	}
+}
+
+uint8_t *get_midi_filter_cc_lut(uint8_t chan, uint8_t cc) {
+	if (chan>15 || cc>127) {
+		fprintf(stderr, "ZynMidiRouter: MIDI CC LUT (%d, %d) is out of range!\n",chan,cc);
+		return NULL;
+	}
+	return midi_filter.cc_val_lut[chan][cc];
+}
+
+void reset_midi_filter_cc_lut(uint8_t chan, uint8_t cc) {
+	if (chan>15 || cc>127) {
+		fprintf(stderr, "ZynMidiRouter: MIDI CC LUT (%d, %d) is out of range!\n",chan,cc);
+		return;
+	}
+	int i;
+	for (i=0; i<128; i++) {
+		midi_filter.cc_val_lut[chan][cc][i]=i;
+	}
+}
+
+void reset_midi_filter_cc_luts() {
+	int i,j;
+	for (i=0;i<16;i++) {
+		for (j=0;j<128;j++) {
+			reset_midi_filter_cc_lut(i,j);
+		}
+	}
+}
+
+//MIDI Channel State cache => updated with the events routed to the channel ports
+
+void update_midi_filter_chan_state(int izmip, uint8_t *data, int size) {
+	uint8_t event_type=data[0] >> 4;
+	if (event_type<CTRL_CHANGE || event_type>PITCH_BENDING || size<2) return;
+	uint8_t chan=data[0] & 0xF;
+	struct zmop_st *zmop=zmops+ZMOP_CH0+chan;
+	if (!zmop->route_from_zmips[izmip]) return;
+
+	struct mf_chan_state_st *state=midi_filter.chan_state+chan;
+	int i;
+	switch (event_type) {
+		case CTRL_CHANGE:
+			if (size<3) return;
+			//Reset All Controllers => bank select, volume & pan are kept
+			if (data[1]==121) {
+				for (i=0;i<128;i++) {
+					if (i!=0 && i!=32 && i!=7 && i!=10) state->ctrl_val[i]=-1;
+				}
+				state->pitchbend=-1;
+				state->pressure=-1;
+			} else {
+				state->ctrl_val[data[1] & 0x7F]=data[2];
+			}
+			break;
+		case PROG_CHANGE:
+			//Dropped by the channel port
+			if ((zmop->flags & FLAG_ZMOP_DROPPC) && izmip!=ZMIP_FAKE_UI) return;
+			state->program=data[1];
+			break;
+		case CHAN_PRESS:
+			state->pressure=data[1];
+			break;
+		case PITCH_BENDING:
+			if (size<3) return;
+			state->pitchbend=(data[2] << 7) | data[1];
+			break;
+	}
+}
+
+int get_midi_filter_chan_program(uint8_t chan) {
+	if (chan>15) {
+		fprintf(stderr, "ZynMidiRouter: MIDI Channel State (%d) is out of range!\n",chan);
+		return -1;
+	}
+	return midi_filter.chan_state[chan].program;
+}
+
+int get_midi_filter_chan_ctrl(uint8_t chan, uint8_t cc) {
+	if (chan>15 || cc>127) {
+		fprintf(stderr, "ZynMidiRouter: MIDI Channel State (%d, %d) is out of range!\n",chan,cc);
+		return -1;
+	}
+	return midi_filter.chan_state[chan].ctrl_val[cc];
+}
+
+void reset_midi_filter_chan_state(int chan) {
+	if (chan>15 || chan<-1) {
+		fprintf(stderr, "ZynMidiRouter: MIDI Channel State (%d) is out of range!\n",chan);
+		return;
+	}
+	int i,j;
+	for (i=0;i<16;i++) {
+		if (chan>=0 && i!=chan) continue;
+		for (j=0;j<128;j++) midi_filter.chan_state[i].ctrl_val[j]=-1;
+		midi_filter.chan_state[i].program=-1;
+		midi_filter.chan_state[i].pressure=-1;
+		midi_filter.chan_state[i].pitchbend=-1;
+	}
+}
+
+//Time of the current jack cycle => held CC values timeout
+jack_time_t jack_cycle_tsus=0;
+
+//Switches, bank select, data entry, RPN/NRPN & channel mode messages are not continuous controllers
+int is_continuous_cc(uint8_t num) {
+	return !(num==0 || num==6 || num==32 || num==38 || (num>=64 && num<=69) || (num>=96 && num<=101) || num>=120);
+}
+
+//Start a controller stream with an encoding => detection restarts
+void init_midi_filter_cc_mode(uint8_t chan, uint8_t cc, uint8_t mode) {
+	struct mf_cc_detect_st *det=&midi_filter.cc_detect[chan][cc];
+	det->mode=mode;
+	det->modes=CC_MODE_RELATIVE;
+	det->val=midi_filter.last_ctrl_val[chan][cc];
+	det->last_raw=-1;
+	det->n_rel=0;
+	det->n=0;
+}
+
+//Encoding of the controllers not set by user => detected for continuous controllers when automode is on
+void init_midi_filter_cc_automodes() {
+	int i,j;
+	for (i=0;i<16;i++) {
+		for (j=0;j<128;j++) {
+			if (midi_filter.cc_detect[i][j].forced) continue;
+			init_midi_filter_cc_mode(i,j,(midi_filter.cc_automode && is_continuous_cc(j)) ? CC_MODE_AUTO : CC_MODE_ABSOLUTE);
+		}
+	}
+}
+
 //MIDI Controller Automode
 void set_midi_filter_cc_automode(int mfccam) {
 	midi_filter.cc_automode=mfccam;
+	init_midi_filter_cc_automodes();
+}
+
+//MIDI Controller Encoding => absolute or relative (endless encoders)
+void set_midi_filter_cc_mode(uint8_t chan, uint8_t cc, uint8_t mode) {
+	if (chan>15 || cc>127) {
+		fprintf(stderr, "ZynMidiRouter: MIDI CC mode (%d, %d) is out of range!\n",chan,cc);
+		return;
+	}
+	if (mode!=CC_MODE_AUTO && mode!=CC_MODE_ABSOLUTE && mode!=CC_MODE_BINOFFSET && mode!=CC_MODE_TWOSCOMP && mode!=CC_MODE_SIGNMAG) {
+		fprintf(stderr, "ZynMidiRouter: Bad MIDI CC mode (%d)!\n",mode);
+		return;
+	}
+	midi_filter.cc_detect[chan][cc].forced=1;
+	init_midi_filter_cc_mode(chan, cc, mode);
+}
+
+//The encoding in use => CC_MODE_AUTO while detecting
+int get_midi_filter_cc_mode(uint8_t chan, uint8_t cc) {
+	if (chan>15 || cc>127) {
+		fprintf(stderr, "ZynMidiRouter: MIDI CC mode (%d, %d) is out of range!\n",chan,cc);
+		return -1;
+	}
+	return midi_filter.cc_detect[chan][cc].mode;
+}
+
+void reset_midi_filter_cc_modes() {
+	int i,j;
+	for (i=0;i<16;i++) {
+		for (j=0;j<128;j++) {
+			midi_filter.cc_detect[i][j].forced=0;
+		}
+	}
+	init_midi_filter_cc_automodes();
+}
+
+//Relative encodings that can produce a value
+uint8_t get_cc_relative_modes(uint8_t val) {
+	uint8_t modes=0;
+	if (val!=64 && abs(val-64)<=CC_DETECT_MAX_DELTA) modes|=CC_MODE_BINOFFSET;
+	if (val!=0 && (val<=CC_DETECT_MAX_DELTA || val>=128-CC_DETECT_MAX_DELTA)) modes|=CC_MODE_TWOSCOMP;
+	if ((val & 0x3F)!=0 && (val & 0x3F)<=CC_DETECT_MAX_DELTA) modes|=CC_MODE_SIGNMAG;
+	return modes;
+}
+
+//Only a relative encoding produces it => a repeated value or a jump. The limits are not taken,
+//as an absolute control can rest on them.
+int is_relative_cc_value(uint8_t val, int16_t last_raw) {
+	if (last_raw<0 || val==0 || val==127) return 0;
+	return val==last_raw || abs(val-last_raw)>CC_DETECT_MAX_JUMP;
+}
+
+uint8_t apply_cc_mode(uint8_t last_val, uint8_t val, uint8_t mode) {
+	int delta;
+	switch (mode) {
+		case CC_MODE_BINOFFSET:
+			delta=(int)val-64;
+			break;
+		case CC_MODE_TWOSCOMP:
+			delta=val<64 ? val : (int)val-128;
+			break;
+		case CC_MODE_SIGNMAG:
+			delta=(val & 0x40) ? -(val & 0x3F) : val;
+			break;
+		default:
+			return val;
+	}
+	delta+=last_val;
+	if (delta>127) delta=127;
+	else if (delta<0) delta=0;
+	return (uint8_t)delta;
+}
+
+//Decode a received CC value. When detecting, the events are held back until the encoding is resolved:
+//absolute as soon as a value can't be relative or the hold buffer is full, relative after a sequence
+//of values that only a relative encoding produces. Then the held steps are decoded, so none is lost,
+//and the encoding is kept until it's set again.
+int decode_midi_filter_cc(uint8_t chan, uint8_t cc, uint8_t val) {
+	struct mf_cc_detect_st *det=&midi_filter.cc_detect[chan][cc];
+	uint8_t mode=det->mode;
+	int i;
+
+	if (mode==CC_MODE_AUTO) {
+		if (!is_continuous_cc(cc)) {
+			det->val=val;
+			return val;
+		}
+		uint8_t modes=det->modes & get_cc_relative_modes(val);
+		if (modes && is_relative_cc_value(val, det->last_raw)) det->n_rel++;
+		else det->n_rel=0;
+		det->last_raw=val;
+
+		if (!modes) mode=CC_MODE_ABSOLUTE;
+		//Most likely relative encoding => binary offset, two's complement, sign-magnitude
+		else if (det->n_rel>=CC_DETECT_RELATIVE_COUNT) mode=modes & -modes;
+		else if (det->n<CC_DETECT_MAX_HOLD) {
+			det->raw[det->n++]=val;
+			det->modes=modes;
+			det->tsus=jack_cycle_tsus;
+			return -1;
+		}
+		else mode=CC_MODE_ABSOLUTE;
+
+		det->mode=mode;
+		for (i=0;i<det->n;i++) det->val=apply_cc_mode(det->val, det->raw[i], mode);
+		det->n=0;
+	}
+	det->val=apply_cc_mode(det->val, val, mode);
+	return det->val;
+}
+
+//Called from the jack thread, when decode_midi_filter_cc() holds a value from input port iz
+void hold_midi_filter_cc(int iz, uint8_t chan, uint8_t cc) {
+	struct mf_cc_detect_st *det=&midi_filter.cc_detect[chan][cc];
+	det->iz=iz;
+	if (det->listed) return;
+	det->listed=1;
+	midi_filter.cc_detect_held[midi_filter.cc_detect_n_held++]=(chan << 7) | cc;
+}
+
+//Held values from input port iz, idle for too long => resolved as absolute, the last one is the value.
+//Returns (chan << 7) | cc, -1 if none. Resolved detectors are removed from the held list.
+int get_midi_filter_cc_timeout(int iz) {
+	int i=0;
+	while (i<midi_filter.cc_detect_n_held) {
+		int key=midi_filter.cc_detect_held[i];
+		struct mf_cc_detect_st *det=&midi_filter.cc_detect[key >> 7][key & 0x7F];
+		int timeout=0;
+		if (det->mode==CC_MODE_AUTO && det->n>0) {
+			if (det->iz!=iz || jack_cycle_tsus-det->tsus<CC_DETECT_HOLD_TIMEOUT_US) {
+				i++;
+				continue;
+			}
+			det->mode=CC_MODE_ABSOLUTE;
+			det->val=det->raw[det->n-1];
+			det->n=0;
+			timeout=1;
+		}
+		det->listed=0;
+		midi_filter.cc_detect_held[i]=midi_filter.cc_detect_held[--midi_filter.cc_detect_n_held];
+		if (timeout) return key;
+	}
+	return -1;
 }
 
 //MIDI System Messages enable/disable
@@ -678,6 +1188,8 @@ int zmop_init(int iz, char *name, int ch, uint32_t flags) {
 	zmops[iz].midi_channel=ch;
 	zmops[iz].n_connections=0;
 	zmops[iz].flags=flags;
+	zmops[iz].replay_step=-1;
+	zmop_reset_program_cache(iz);
 
 	int i;
 	for (i=0;i<MAX_NUM_ZMIPS;i++)
@@ -722,6 +1234,48 @@ int zmop_chan_get_flag_droppc(int ch) {
 	return zmops[ZMOP_CH0 + ch].flags & (uint32_t)FLAG_ZMOP_DROPPC;
 }
 
+int zmop_chan_set_flag_deduppc(int ch, uint8_t flag) {
+	if (ch<0 || ch>=16) {
+		fprintf(stderr, "ZynMidiRouter: Bad output port chan (%d).\n", ch);
+		return 0;
+	}
+	if (flag) zmops[ZMOP_CH0 + ch].flags|=(uint32_t)FLAG_ZMOP_DEDUPPC;
+	else zmops[ZMOP_CH0 + ch].flags&=~(uint32_t)FLAG_ZMOP_DEDUPPC;
+	return 1;
+}
+
+int zmop_chan_get_flag_deduppc(int ch) {
+	if (ch<0 || ch>=16) {
+		fprintf(stderr, "ZynMidiRouter: Bad output port chan (%d).\n", ch);
+		return 0;
+	}
+	return (zmops[ZMOP_CH0 + ch].flags & (uint32_t)FLAG_ZMOP_DEDUPPC)!=0;
+}
+
+void zmop_reset_program_cache(int iz) {
+	int i;
+	for (i=0;i<16;i++) {
+		zmops[iz].bank[i]=-1;
+		zmops[iz].pc_bank[i]=-1;
+		zmops[iz].program[i]=-1;
+	}
+}
+
+//Track the bank select & program change events written to the port
+void zmop_update_program_cache(int iz, const jack_midi_data_t *data) {
+	struct zmop_st *zmop=zmops+iz;
+	uint8_t event_type=data[0] >> 4;
+	uint8_t chan=data[0] & 0xF;
+	if (event_type==CTRL_CHANGE) {
+		//Bank MSB resets the LSB
+		if (data[1]==0) zmop->bank[chan]=data[2] << 7;
+		else if (data[1]==32) zmop->bank[chan]=(zmop->bank[chan]<0 ? 0 : zmop->bank[chan] & 0x3F80) | data[2];
+	} else if (event_type==PROG_CHANGE) {
+		zmop->pc_bank[chan]=zmop->bank[chan];
+		zmop->program[chan]=data[1];
+	}
+}
+
 int zmop_set_route_from(int izmop, int izmip, int route) {
 	if (izmop<0 || izmop>=MAX_NUM_ZMOPS) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", izmop);
@@ -735,6 +1289,24 @@ int zmop_set_route_from(int izmop, int izmip, int route) {
 	return 1;
 }
 
+int zmop_set_flag_coalesce(int iz, uint8_t flag) {
+	if (iz<0 || iz>=MAX_NUM_ZMOPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
+		return 0;
+	}
+	if (flag) zmops[iz].flags|=(uint32_t)FLAG_ZMOP_COALESCE;
+	else zmops[iz].flags&=~(uint32_t)FLAG_ZMOP_COALESCE;
+	return 1;
+}
+
+int zmop_get_flag_coalesce(int iz) {
+	if (iz<0 || iz>=MAX_NUM_ZMOPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
+		return 0;
+	}
+	return (zmops[iz].flags & (uint32_t)FLAG_ZMOP_COALESCE)!=0;
+}
+
 int zmop_reset_event_counters(int iz) {
 	if (iz<0 || iz>=MAX_NUM_ZMOPS) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
@@ -778,6 +1350,153 @@ jack_midi_event_t *zmop_pop_event(int izmop, int *izmip) {
 }
 
 
+//Coalesced cycle events => zmops are processed one by one from the jack thread
+#define COALESCE_KEY_PB 128
+#define COALESCE_KEY_CP 129
+struct zmop_cycle_event_st {
+	jack_midi_event_t *ev;
+	int izmip;
+	uint8_t drop;
+};
+struct zmop_cycle_event_st zmop_cycle_events[JACK_MIDI_BUFFER_SIZE];
+int zmop_cycle_n=0;
+int zmop_cycle_i=0;
+
+//Pop the cycle events of a zmop, marking the continuous controller values that are
+//superseded by a later one. Returns the number of events.
+int zmop_coalesce_events(int izmop) {
+	int16_t last[16][130];
+	uint16_t last_epoch[16][130];
+	uint16_t epoch[16];
+	int izmip, n=0;
+	jack_midi_event_t *ev;
+
+	memset(last, 0xFF, sizeof(last));
+	memset(epoch, 0, sizeof(epoch));
+	while (n<JACK_MIDI_BUFFER_SIZE && (ev=zmop_pop_event(izmop, &izmip))) {
+		struct zmop_cycle_event_st *cev=zmop_cycle_events+n;
+		cev->ev=ev;
+		cev->izmip=izmip;
+		cev->drop=0;
+		uint8_t event_type=ev->buffer[0] >> 4;
+		if (event_type>=NOTE_OFF && event_type<=PITCH_BENDING) {
+			uint8_t chan=ev->buffer[0] & 0xF;
+			int key=-1;
+			if (event_type==CTRL_CHANGE && ev->size==3 && is_continuous_cc(ev->buffer[1])) key=ev->buffer[1];
+			else if (event_type==PITCH_BENDING) key=COALESCE_KEY_PB;
+			else if (event_type==CHAN_PRESS) key=COALESCE_KEY_CP;
+			if (key>=0) {
+				//Same controller since the last barrier => the previous value is superseded
+				if (last[chan][key]>=0 && last_epoch[chan][key]==epoch[chan]) zmop_cycle_events[last[chan][key]].drop=1;
+				last[chan][key]=n;
+				last_epoch[chan][key]=epoch[chan];
+			} else {
+				epoch[chan]++;
+			}
+		}
+		n++;
+	}
+	zmop_cycle_n=n;
+	zmop_cycle_i=0;
+	return n;
+}
+
+//Next event to write => coalesced events first, then the remaining ones (if any)
+jack_midi_event_t *zmop_next_event(int izmop, int *izmip) {
+	while (zmop_cycle_i<zmop_cycle_n) {
+		struct zmop_cycle_event_st *cev=zmop_cycle_events+(zmop_cycle_i++);
+		if (cev->drop) continue;
+		*izmip=cev->izmip;
+		return cev->ev;
+	}
+	return zmop_pop_event(izmop, izmip);
+}
+
+int zmop_replay_chan_state(int iz) {
+	if (iz<0 || iz>=MAX_NUM_ZMOPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
+		return 0;
+	}
+	if (zmops[iz].midi_channel<0) return 0;
+	zmops[iz].replay_step=0;
+	return 1;
+}
+
+//Controllers, pitch-bend & pressure only. A full replay in progress goes on.
+int zmop_replay_chan_ctrls(int iz) {
+	if (iz<0 || iz>=MAX_NUM_ZMOPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
+		return 0;
+	}
+	if (zmops[iz].midi_channel<0) return 0;
+	if (zmops[iz].replay_step<0 || zmops[iz].replay_step>ZMOP_REPLAY_STEP_CC) zmops[iz].replay_step=ZMOP_REPLAY_STEP_CC;
+	return 1;
+}
+
+//Replay steps => 0: bank MSB, 1: bank LSB, 2: program, 3-130: controllers, pitch-bend, pressure
+int is_replayable_cc(uint8_t num) {
+	return !(num==0 || num==32 || num==6 || num==38 || (num>=96 && num<=101) || num>=120);
+}
+
+//Write the next channel state events at the start of the cycle => number of events written
+int zmop_write_chan_state(int iz, void *output_port_buffer) {
+	struct zmop_st *zmop=zmops+iz;
+	struct mf_chan_state_st *state=midi_filter.chan_state+zmop->midi_channel;
+	uint8_t chan=zmop->midi_channel;
+	jack_midi_data_t buffer[3];
+	int n=0;
+	while (zmop->replay_step>=0 && n<ZMOP_REPLAY_MAX_EVENTS) {
+		int step=zmop->replay_step;
+		int size=0;
+		if (step==0 || step==1) {
+			int num=step ? 32 : 0;
+			if (state->ctrl_val[num]>=0) {
+				buffer[0]=(CTRL_CHANGE << 4) | chan;
+				buffer[1]=num;
+				buffer[2]=state->ctrl_val[num];
+				size=3;
+			}
+		} else if (step==2) {
+			if (state->program>=0) {
+				buffer[0]=(PROG_CHANGE << 4) | chan;
+				buffer[1]=state->program;
+				size=2;
+			}
+		} else if (step<ZMOP_REPLAY_STEP_PB) {
+			int num=step-ZMOP_REPLAY_STEP_CC;
+			if (is_replayable_cc(num) && state->ctrl_val[num]>=0) {
+				buffer[0]=(CTRL_CHANGE << 4) | chan;
+				buffer[1]=num;
+				buffer[2]=state->ctrl_val[num];
+				size=3;
+			}
+		} else if (step==ZMOP_REPLAY_STEP_PB) {
+			if (state->pitchbend>=0) {
+				int pb=state->pitchbend;
+				if ((zmop->flags & FLAG_ZMOP_TUNING) && midi_filter.tuning_pitchbend>=0) pb=get_tuned_pitchbend(pb);
+				buffer[0]=(PITCH_BENDING << 4) | chan;
+				buffer[1]=pb & 0x7F;
+				buffer[2]=(pb >> 7) & 0x7F;
+				size=3;
+			}
+		} else if (step==ZMOP_REPLAY_STEP_CP) {
+			if (state->pressure>=0) {
+				buffer[0]=(CHAN_PRESS << 4) | chan;
+				buffer[1]=state->pressure;
+				size=2;
+			}
+		}
+		if (size>0) {
+			//Buffer full => continue in the next cycle
+			if (jack_midi_event_write(output_port_buffer, 0, buffer, size)!=0) break;
+			zmop_update_program_cache(iz, buffer);
+			n++;
+		}
+		if (++zmop->replay_step>=ZMOP_REPLAY_STEP_END) zmop->replay_step=-1;
+	}
+	return n;
+}
+
 int zmip_init(int iz, char *name, uint32_t flags) {
 	if (iz<0 || iz>=MAX_NUM_ZMIPS) {
 		fprintf(stderr, "ZynMidiRouter: Bad index (%d) initializing input port '%s'.\n", iz, name);
@@ -798,6 +1517,8 @@ int zmip_init(int iz, char *name, uint32_t flags) {
 	//Set init values
 	zmips[iz].flags=flags;
 	zmips[iz].n_events=0;
+	zmip_set_velocity_curve(iz, -1, ZMIP_VELOCITY_LINEAR, 0);
+	zmip_reset_note_owners(iz);
 
 	return 1;
 }
@@ -819,6 +1540,84 @@ int zmip_has_flags(int iz, uint32_t flags) {
 	return (zmips[iz].flags & flags)==flags;
 }
 
+//Velocity 0 is note-off, so it's kept and the other values are not mapped to 0
+int zmip_set_velocity_lut(int iz, int chan, uint8_t lut[128]) {
+	if (iz<0 || iz>=MAX_NUM_ZMIPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
+		return 0;
+	}
+	if (chan<-1 || chan>15) {
+		fprintf(stderr, "ZynMidiRouter: Velocity curve chan (%d) is out of range!\n", chan);
+		return 0;
+	}
+	int i, j;
+	for (j=0; j<16; j++) {
+		if (chan>=0 && j!=chan) continue;
+		zmips[iz].velocity_curve[j][0]=0;
+		for (i=1; i<128; i++) {
+			uint8_t vel=lut[i] & 0x7F;
+			zmips[iz].velocity_curve[j][i]=vel ? vel : 1;
+		}
+	}
+	return 1;
+}
+
+int zmip_set_velocity_curve(int iz, int chan, int curve, uint8_t param) {
+	uint8_t lut[128];
+	int i;
+	for (i=0; i<128; i++) {
+		double x=i/127.0;
+		switch (curve) {
+			case ZMIP_VELOCITY_LOG:
+				lut[i]=(uint8_t)lround(127.0*log1p(9.0*x)/log(10.0));
+				break;
+			case ZMIP_VELOCITY_EXP:
+				lut[i]=(uint8_t)lround(127.0*(pow(10.0, x)-1.0)/9.0);
+				break;
+			case ZMIP_VELOCITY_FIXED:
+				lut[i]=param;
+				break;
+			default:
+				lut[i]=i;
+		}
+	}
+	return zmip_set_velocity_lut(iz, chan, lut);
+}
+
+uint8_t *zmip_get_velocity_lut(int iz, int chan) {
+	if (iz<0 || iz>=MAX_NUM_ZMIPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
+		return NULL;
+	}
+	if (chan<0 || chan>15) {
+		fprintf(stderr, "ZynMidiRouter: Velocity curve chan (%d) is out of range!\n", chan);
+		return NULL;
+	}
+	return zmips[iz].velocity_curve[chan];
+}
+
+//Called from the jack thread, when a note-on is forwarded
+void zmip_add_note_owner(int iz, uint8_t chan, uint8_t note, uint8_t chan_to, uint8_t note_to) {
+	struct zmip_note_owner_st *owner=&zmips[iz].note_owners[chan & 0xF][note & 0x7F];
+	int i;
+	//Retriggered note => same destination
+	for (i=0; i<owner->n; i++) {
+		if (owner->dests[i].chan==chan_to && owner->dests[i].note==note_to) return;
+	}
+	if (owner->n>=MAX_NOTE_OWNER_DESTS) return;
+	owner->dests[owner->n].chan=chan_to;
+	owner->dests[owner->n].note=note_to;
+	owner->n++;
+}
+
+void zmip_reset_note_owners(int iz) {
+	if (iz<0 || iz>=MAX_NUM_ZMIPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
+		return;
+	}
+	memset(zmips[iz].note_owners, 0, sizeof(zmips[iz].note_owners));
+}
+
 int zmip_push_event(int iz, jack_midi_event_t *ev) {
 	if (iz<0 || iz>=MAX_NUM_ZMIPS) {
 		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
@@ -826,6 +1625,7 @@ int zmip_push_event(int iz, jack_midi_event_t *ev) {
 	}
 
 	zmips[iz].events[zmips[iz].n_events++]=*ev;
+	update_midi_filter_chan_state(iz, ev->buffer, ev->size);
 	return 1;
 }
 
@@ -842,6 +1642,7 @@ int zmip_push_event_data(int iz, uint8_t *data) {
 	if (data[0]>=0xF4) ev->size=1;
 	else if (event_type==PROG_CHANGE || event_type==CHAN_PRESS || event_type==TIME_CODE_QF || event_type==SONG_SELECT) ev->size=2;
 	else ev->size=3;
+	update_midi_filter_chan_state(iz, data, ev->size);
 
 	if (zmips[iz].n_events>1) {
 		ev->time=zmips[iz].events[zmips[iz].n_events-2].time+1;
@@ -974,7 +1775,50 @@ int end_jack_midi() {
 //-----------------------------------------------------
 
 int current_midi_filter_active_chan;
+//Data of the events created in the cycle (clones, layers, note-offs), shared by all the zmips
 uint8_t event_buffer_data[JACK_MIDI_BUFFER_SIZE];
+uint8_t *ebd_pointer;
+
+//Fan-out => copies of the event in the same position of the timeline, from the shared event buffer
+void zmip_push_event_fanout(int iz, struct mf_fanout_map_st *fanout_map, jack_midi_event_t *ev, uint8_t type, uint8_t chan, uint8_t num, uint8_t val, int owner_chan, uint8_t owner_note, int skip_notes) {
+	int n=fanout_map->count[type & 0x7][chan][num];
+	struct mf_fanout_dest_st *dest=fanout_map->dests+fanout_map->first[type & 0x7][chan][num];
+	for (; n>0 && ebd_pointer+3<=event_buffer_data+JACK_MIDI_BUFFER_SIZE; n--, dest++) {
+		uint8_t dest_type=dest->status >> 4;
+		uint8_t dest_chan=dest->status & 0xF;
+		uint8_t dest_val=dest->val_lut[val];
+		//Note-offs of owned notes => the note destinations are in the ownership table
+		if (skip_notes && (dest_type==NOTE_ON || dest_type==NOTE_OFF)) continue;
+		jack_midi_event_t fev=*ev;
+		fev.buffer=ebd_pointer;
+		fev.buffer[0]=dest->status;
+		if (dest_type==PROG_CHANGE) {
+			fev.buffer[1]=dest->num;
+			fev.size=2;
+		} else if (dest_type==CHAN_PRESS) {
+			fev.buffer[1]=dest_val;
+			fev.size=2;
+		} else if (dest_type==PITCH_BENDING) {
+			fev.buffer[1]=0;
+			fev.buffer[2]=dest_val;
+			fev.size=3;
+		} else {
+			fev.buffer[1]=dest->num;
+			fev.buffer[2]=dest_val;
+			fev.size=3;
+		}
+		ebd_pointer+=fev.size;
+		if (dest_type==CTRL_CHANGE) {
+			midi_filter.last_ctrl_val[dest_chan][dest->num]=dest_val;
+		} else if (dest_type==NOTE_ON && dest_val>0) {
+			midi_filter.note_state[dest_chan][dest->num]=dest_val;
+			if (owner_chan>=0) zmip_add_note_owner(iz, owner_chan, owner_note, dest_chan, dest->num);
+		} else if (dest_type==NOTE_ON || dest_type==NOTE_OFF) {
+			midi_filter.note_state[dest_chan][dest->num]=0;
+		}
+		zmip_push_event(iz, &fev);
+	}
+}
 
 int jack_process_zmip(int iz, jack_nframes_t nframes) {
 	if (iz<0 || iz>=MAX_NUM_ZMIPS) {
@@ -1001,13 +1845,30 @@ int jack_process_zmip(int iz, jack_nframes_t nframes) {
 
 	//Process MIDI messages
 
+	//Compiled zones & fan-outs => the published copies are valid until the cycle ends
+	struct mf_zone_map_st *zone_map=midi_filter.zone_maps+__atomic_load_n(&midi_filter.zone_map_i, __ATOMIC_ACQUIRE);
+	struct mf_fanout_map_st *fanout_map=midi_filter.fanout_maps+__atomic_load_n(&midi_filter.fanout_map_i, __ATOMIC_ACQUIRE);
+
 	jack_midi_event_t ev;
 	int clone_from_chan=-1;
 	int clone_to_chan=-1;
-	uint8_t *ebd_pointer=event_buffer_data;
+	//Incoming note-on => owner of the forwarded notes
+	int owner_chan=-1;
+	int owner_note=0;
+	int cloned=0;
+	//CC values held back while detecting the encoding => the timed out ones are emitted first
+	int held_done=!(zmip->flags & FLAG_ZMIP_FILTER) || midi_filter.cc_detect_n_held==0;
+	int held_key;
+	int timed_out=0;
 
 	while (1) {
 
+		//Event buffer full => stop cloning
+		if (clone_from_chan>=0 && ebd_pointer+ev.size>event_buffer_data+JACK_MIDI_BUFFER_SIZE) {
+			clone_from_chan=-1;
+			clone_to_chan=-1;
+		}
+
 		//Clone from last event ...
 		if (clone_from_chan>=0 && clone_to_chan>=0 && clone_to_chan<16) {
 			memcpy(ebd_pointer, ev.buffer, ev.size);
@@ -1042,10 +1903,39 @@ int jack_process_zmip(int iz, jack_nframes_t nframes) {
 			//loggin.debug("CLONING EVENT %d => %d [0x%x, %d]\n", clone_from_chan, clone_to_chan, event_type, event_num);
 
 			clone_to_chan++;
+			cloned=1;
+		}
+		//Or a held CC value that timed out => absolute, at the start of the cycle
+		else if (!held_done && ebd_pointer+3<=event_buffer_data+JACK_MIDI_BUFFER_SIZE && (held_key=get_midi_filter_cc_timeout(iz))>=0) {
+			event_type=CTRL_CHANGE;
+			event_chan=held_key >> 7;
+			event_num=held_key & 0x7F;
+			event_val=midi_filter.cc_detect[event_chan][event_num].val;
+			ev.buffer=ebd_pointer;
+			ebd_pointer+=3;
+			ev.buffer[0]=(event_type << 4) | event_chan;
+			ev.buffer[1]=event_num;
+			ev.buffer[2]=event_val;
+			ev.size=3;
+			ev.time=0;
+			cloned=0;
+			timed_out=1;
+			owner_chan=-1;
+			if (zmip->flags & FLAG_ZMIP_CLONE) {
+				clone_from_chan=event_chan;
+				clone_to_chan=0;
+			}
+			else {
+				clone_from_chan=-1;
+				clone_to_chan=-1;
+			}
 		}
 		//Or get next event ...
 		else {
+			held_done=1;
 			if (jack_midi_event_get(&ev, input_port_buffer, i++)!=0) break;
+			cloned=0;
+			timed_out=0;
 
 			//Ignore Active Sense & SysEx messages => Is it OK?
 			if (ev.buffer[0]==ACTIVE_SENSE || ev.buffer[0]==SYSTEM_EXCLUSIVE) continue;
@@ -1083,23 +1973,59 @@ int jack_process_zmip(int iz, jack_nframes_t nframes) {
 				event_num=event_val=0;
 			}
 
+			owner_chan=-1;
 			if (ev.buffer[0]<SYSTEM_EXCLUSIVE && event_chan!=midi_filter.master_chan) {
+				//Note-off => sent to the destinations of its note-on, whatever the current settings
+				if (event_type==NOTE_OFF || (event_type==NOTE_ON && event_val==0)) {
+					struct zmip_note_owner_st *owner=&zmip->note_owners[event_chan][event_num];
+					if (owner->n>0) {
+						//Capture events for UI: before filtering when MIDI learning, else the first destination
+						if (zmip->flags & FLAG_ZMIP_UI) {
+							if (midi_learning_mode) write_zynmidi((ev.buffer[0]<<16)|(ev.buffer[1]<<8)|(ev.buffer[2]));
+							else write_zynmidi((((event_type << 4) | owner->dests[0].chan)<<16)|(owner->dests[0].note<<8)|event_val);
+						}
+						for (j=0; j<owner->n && ebd_pointer+3<=event_buffer_data+JACK_MIDI_BUFFER_SIZE; j++) {
+							jack_midi_event_t oev=ev;
+							oev.buffer=ebd_pointer;
+							ebd_pointer+=3;
+							oev.buffer[0]=(event_type << 4) | owner->dests[j].chan;
+							oev.buffer[1]=owner->dests[j].note;
+							oev.buffer[2]=event_val;
+							oev.size=3;
+							midi_filter.note_state[owner->dests[j].chan][owner->dests[j].note]=0;
+							zmip_push_event(iz, &oev);
+						}
+						//Event buffer full => the destinations not sent are kept for the next note-off
+						owner->n-=j;
+						if (owner->n>0) memmove(owner->dests, owner->dests+j, owner->n*sizeof(struct zmip_note_dest_st));
+						//Fan-out to other event types => from the current active channel, as the note-on
+						if (zmip->flags & FLAG_ZMIP_FILTER) {
+							uint8_t fanout_chan=event_chan;
+							if ((zmip->flags & FLAG_ZMIP_ACTIVE_CHAN) && current_midi_filter_active_chan>=0) fanout_chan=current_midi_filter_active_chan;
+							zmip_push_event_fanout(iz, fanout_map, &ev, event_type, fanout_chan, event_num, event_val, -1, 0, 1);
+						}
+						clone_from_chan=-1;
+						clone_to_chan=-1;
+						continue;
+					}
+				}
+				else if (event_type==NOTE_ON) {
+					owner_chan=event_chan;
+					owner_note=event_num;
+				}
+				//All Sound/Notes Off => the channel notes are released, forget their destinations
+				else if (event_type==CTRL_CHANGE && (event_num==120 || event_num==123)) {
+					memset(zmip->note_owners[event_chan], 0, sizeof(zmip->note_owners[event_chan]));
+				}
+
 				//Active Channel => When set, move all channel events to active_chan
 				if ((zmip->flags & FLAG_ZMIP_ACTIVE_CHAN) && current_midi_filter_active_chan>=0) {
 					int destiny_chan=current_midi_filter_active_chan;
 
 					if (midi_filter.last_active_chan>=0) { 
-						// Release pressed notes across active channel changes, excluding cloned channels
-						if (event_type==NOTE_OFF || (event_type==NOTE_ON && event_val==0)) {
-							for (j=0; j<16; j++) {
-								if (j!=destiny_chan && midi_filter.note_state[j][event_num]>0 && !midi_filter.clone[destiny_chan][j].enabled) {
-									destiny_chan=j;
-									//internal_send_note_off(j, event_num, event_val);
-								}
-							}
-						}
+						// Pressed notes are released through the note ownership table
 						// Manage sustain pedal across active_channel changes, excluding cloned channels
-						else if (event_type==CTRL_CHANGE && event_num==64) {
+						if (event_type==CTRL_CHANGE && event_num==64) {
 							for (j=0; j<16; j++) {
 								if (j!=destiny_chan && midi_filter.last_ctrl_val[j][64]>0 && !midi_filter.clone[destiny_chan][j].enabled) {
 									internal_send_ccontrol_change(j, 64, event_val);
@@ -1120,8 +2046,9 @@ int jack_process_zmip(int iz, jack_nframes_t nframes) {
 				}
 			}
 			
-			//Is it a clonable event?
-			if ((zmip->flags & FLAG_ZMIP_CLONE) && (event_type==NOTE_OFF || event_type==NOTE_ON || event_type==PITCH_BENDING || event_type==KEY_PRESS || event_type==CHAN_PRESS || event_type==CTRL_CHANGE)) {
+			//Is it a clonable event? Notes on channels with zones are layered by the zone lookup.
+			if ((zmip->flags & FLAG_ZMIP_CLONE) && (event_type==NOTE_OFF || event_type==NOTE_ON || event_type==PITCH_BENDING || event_type==KEY_PRESS || event_type==CHAN_PRESS || event_type==CTRL_CHANGE)
+				&& !(zone_map->enabled[event_chan] && (zmip->flags & FLAG_ZMIP_NOTERANGE) && (event_type==NOTE_OFF || event_type==NOTE_ON))) {
 				clone_from_chan=event_chan;
 				clone_to_chan=0;
 			}
@@ -1148,6 +2075,20 @@ int jack_process_zmip(int iz, jack_nframes_t nframes) {
 			ui_event=(ev.buffer[0]<<16)|(ev.buffer[1]<<8)|(ev.buffer[2]);
 		}
 
+		//Relative encodings (endless encoders) => absolute value, before mapping. Clones are already decoded.
+		if (event_type==CTRL_CHANGE && !cloned && !timed_out && (zmip->flags & FLAG_ZMIP_FILTER)) {
+			int val=decode_midi_filter_cc(event_chan, event_num, event_val);
+			//Detecting the encoding => the event is held back
+			if (val<0) {
+				hold_midi_filter_cc(iz, event_chan, event_num);
+				if (ui_event) write_zynmidi(ui_event);
+				clone_from_chan=-1;
+				clone_to_chan=-1;
+				continue;
+			}
+			ev.buffer[2]=event_val=val;
+		}
+
 		//Event Mapping
 		if ((zmip->flags & FLAG_ZMIP_FILTER) && event_type>=NOTE_OFF && event_type<=PITCH_BENDING) {
 			struct midi_event_st *event_map=&midi_filter.event_map[event_type & 0x7][event_chan][event_num];
@@ -1156,6 +2097,12 @@ int jack_process_zmip(int iz, jack_nframes_t nframes) {
 				//fprintf(stdout, "IGNORE => %x, %x, %x\n",event_type, event_chan, event_num);
 				continue;
 			}
+			//Fan-out => extra destinations, from the decoded source event
+			zmip_push_event_fanout(iz, fanout_map, &ev, event_type, event_chan, event_num, event_val, owner_chan, owner_note, 0);
+			//Transform CC value (identity by default) => after decoding, so relative steps are absolute. Clones are already transformed.
+			if (event_type==CTRL_CHANGE && !cloned) {
+				ev.buffer[2]=event_val=midi_filter.cc_val_lut[event_chan][event_num][event_val];
+			}
 			//Map event ...
 			if (event_map->type>=0) {
 				//fprintf(stdout, "ZynMidiRouter: Event Map %x, %x => ",ev.buffer[0],ev.buffer[1]);
@@ -1195,47 +2142,6 @@ int jack_process_zmip(int iz, jack_nframes_t nframes) {
 		//MIDI CC messages => TODO: Clone behaviour?!!
 		if (event_type==CTRL_CHANGE) {
 
-			//Auto Relative-Mode
-			if (midi_filter.ctrl_mode[event_chan][event_num]==1) {
-				// Change to absolut mode
-				if (midi_filter.ctrl_relmode_count[event_chan][event_num]>1) {
-					midi_filter.ctrl_mode[event_chan][event_num]=0;
-					//printf("Changing Back to Absolut Mode ...\n");
-				}
-				// Every 2 messages, rel-mode mark. Between 2 marks, can't have a val of 64.
-				else if (event_val==64) {
-					if (midi_filter.ctrl_relmode_count[event_chan][event_num]==1) {
-						midi_filter.ctrl_relmode_count[event_chan][event_num]=0;
-						continue;
-					} else {
-						midi_filter.ctrl_mode[event_chan][event_num]=0;
-						//printf("Changing Back to Absolut Mode ...\n");
-					}
-				}
-				else {
-					int16_t last_val=midi_filter.last_ctrl_val[event_chan][event_num];
-					int16_t new_val=last_val + (int16_t)event_val - 64;
-					if (new_val>127) new_val=127;
-					if (new_val<0) new_val=0;
-					ev.buffer[2]=event_val=(uint8_t)new_val;
-					midi_filter.ctrl_relmode_count[event_chan][event_num]++;
-					//printf("Relative Mode! => val=%d\n",new_val);
-				}
-			}
-
-			//Absolut Mode
-			if (midi_filter.ctrl_mode[event_chan][event_num]==0 && midi_filter.cc_automode==1) {
-				if (event_val==64) {
-					//printf("Tenting Relative Mode ...\n");
-					midi_filter.ctrl_mode[event_chan][event_num]=1;
-					midi_filter.ctrl_relmode_count[event_chan][event_num]=0;
-					// Here we lost a tick when an absolut knob moves fast and touch val=64,
-					// but if we want auto-detect rel-mode and change softly to it, it's the only way.
-					int16_t last_val=midi_filter.last_ctrl_val[event_chan][event_num];
-					if (abs(last_val-event_val)>4) continue;
-				}
-			}
-
 			//Save last controller value ...
 			midi_filter.last_ctrl_val[event_chan][event_num]=event_val;
 
@@ -1247,22 +2153,54 @@ int jack_process_zmip(int iz, jack_nframes_t nframes) {
 
 		//Note-range & Transpose Note-on/off messages => TODO: Bizarre clone behaviour?
 		else if ((zmip->flags & FLAG_ZMIP_NOTERANGE) && (event_type==NOTE_OFF || event_type==NOTE_ON)) {
-			int discard_note=0;
-			int note=ev.buffer[1];
-			//Note-range
-			if (note<midi_filter.noterange[event_chan].note_low || note>midi_filter.noterange[event_chan].note_high) discard_note=1;
-			//Transpose
-			if (!discard_note) {
-				note+=12*midi_filter.noterange[event_chan].octave_trans;
-				note+=midi_filter.noterange[event_chan].halftone_trans;
-				//If result note is out of range, ignore it ...
-				if (note>0x7F || note<0) discard_note=1;
-				else event_num=ev.buffer[1]=(uint8_t)(note & 0x7F);
+			//Velocity curve => clones are copies of the already processed event
+			if (event_type==NOTE_ON && !cloned) {
+				ev.buffer[2]=event_val=zmip->velocity_curve[event_chan][event_val];
 			}
-			if (discard_note) {
-				//If already captured, forward event to UI
-				if (ui_event) write_zynmidi(ui_event);
-				continue;
+			//Zones => split, layer & transpose in a single lookup
+			if (zone_map->enabled[event_chan]) {
+				int n=zone_map->count[event_chan][event_num];
+				if (n==0) {
+					//If already captured, forward event to UI
+					if (ui_event) write_zynmidi(ui_event);
+					continue;
+				}
+				struct mf_zone_target_st *targets=zone_map->targets[event_chan][event_num];
+				//Layers => a copy of the event for every extra target
+				for (j=1; j<n && ebd_pointer+ev.size<=event_buffer_data+JACK_MIDI_BUFFER_SIZE; j++) {
+					jack_midi_event_t zev=ev;
+					zev.buffer=ebd_pointer;
+					ebd_pointer+=ev.size;
+					zev.buffer[0]=(event_type << 4) | targets[j].chan;
+					zev.buffer[1]=targets[j].note;
+					zev.buffer[2]=event_val;
+					if (event_type==NOTE_ON) midi_filter.note_state[targets[j].chan][targets[j].note]=event_val;
+					else midi_filter.note_state[targets[j].chan][targets[j].note]=0;
+					if (owner_chan>=0 && event_type==NOTE_ON && event_val>0) zmip_add_note_owner(iz, owner_chan, owner_note, targets[j].chan, targets[j].note);
+					zmip_push_event(iz, &zev);
+				}
+				event_chan=targets[0].chan;
+				event_num=targets[0].note;
+				ev.buffer[0]=(event_type << 4) | event_chan;
+				ev.buffer[1]=event_num;
+			} else {
+				int discard_note=0;
+				int note=ev.buffer[1];
+				//Note-range
+				if (note<midi_filter.noterange[event_chan].note_low || note>midi_filter.noterange[event_chan].note_high) discard_note=1;
+				//Transpose
+				if (!discard_note) {
+					note+=12*midi_filter.noterange[event_chan].octave_trans;
+					note+=midi_filter.noterange[event_chan].halftone_trans;
+					//If result note is out of range, ignore it ...
+					if (note>0x7F || note<0) discard_note=1;
+					else event_num=ev.buffer[1]=(uint8_t)(note & 0x7F);
+				}
+				if (discard_note) {
+					//If already captured, forward event to UI
+					if (ui_event) write_zynmidi(ui_event);
+					continue;
+				}
 			}
 		}
 
@@ -1298,6 +2236,10 @@ int jack_process_zmip(int iz, jack_nframes_t nframes) {
 			midi_event_zyncoders(event_chan, event_num, event_val);
 		}
 
+		//Note ownership => the note-off will follow this note-on
+		if (owner_chan>=0 && event_type==NOTE_ON && event_val>0) {
+			zmip_add_note_owner(iz, owner_chan, owner_note, event_chan, event_num);
+		}
 
 		zmip_push_event(iz, &ev);
 	}
@@ -1335,12 +2277,17 @@ int jack_process_zmop(int iz, jack_nframes_t nframes) {
 
 	//fprintf(stderr, "ZynMidiRouter: Processing ZMOP %d\n",iz);
 
+	//Channel state replay for new connections => before the cycle events
+	if (zmop->replay_step>=0) i+=zmop_write_chan_state(iz, output_port_buffer);
+
 	//Write MIDI data
 	//TODO: Avoid frame overflow by checking that num_zmop_events<nframes => implement ring buffer in zmop??
 
 	zmop_reset_event_counters(iz);
+	zmop_cycle_n=zmop_cycle_i=0;
+	if (zmop->flags & FLAG_ZMOP_COALESCE) zmop_coalesce_events(iz);
 
-	while (ev=zmop_pop_event(iz, &izmip)) {
+	while (ev=zmop_next_event(iz, &izmip)) {
 		event_type= ev->buffer[0] >> 4;
 
 		//fprintf(stderr, "\nZynMidiRouter: Processing Event of type %d\n",event_type);
@@ -1356,6 +2303,14 @@ int jack_process_zmop(int iz, jack_nframes_t nframes) {
 		if  (event_type==PROG_CHANGE && (zmop->flags & FLAG_ZMOP_DROPPC) && izmip!=ZMIP_FAKE_UI) {
 			continue;
 		}
+
+		//Drop repeated "Program Change" => same bank & program as the last one written
+		if (event_type==PROG_CHANGE && (zmop->flags & FLAG_ZMOP_DEDUPPC) && izmip!=ZMIP_FAKE_UI) {
+			event_chan=ev->buffer[0] & 0xF;
+			if (zmop->program[event_chan]==ev->buffer[1] && zmop->pc_bank[event_chan]==zmop->bank[event_chan]) {
+				continue;
+			}
+		}
 		
 		// Fine-Tuning, using pitch-bending messages ...
 		xev.size=0;
@@ -1393,6 +2348,9 @@ int jack_process_zmop(int iz, jack_nframes_t nframes) {
 			fprintf(stderr, "ZynMidiRouter: Error writing jack midi output event!\n");
 			continue;
 		}
+		if (event_type==PROG_CHANGE || (event_type==CTRL_CHANGE && (ev->buffer[1]==0 || ev->buffer[1]==32))) {
+			zmop_update_program_cache(iz, ev->buffer);
+		}
 		i++;
 
 		if (xev.size>0) {
@@ -1414,23 +2372,36 @@ int jack_process_zmop(int iz, jack_nframes_t nframes) {
 // Jack Process
 //-----------------------------------------------------
 
-int jack_process(jack_nframes_t nframes, void *arg) {
+int jack_process_cycle(jack_nframes_t nframes) {
 	int i;
 
-	// Get current Active Chan
+	// Get current Active Chan & time
 	current_midi_filter_active_chan=midi_filter.active_chan;
+	jack_cycle_tsus=jack_get_time();
 	
 	//---------------------------------
 	// Clear Output Port Data Buffers
 	//---------------------------------
 	zmips_clear_events();
+	ebd_pointer=event_buffer_data;
 	//fprintf(stderr, "ZynMidiRouter: ZMIPs events cleaned\n");
 
 	//---------------------------------
 	// Get number of connection of Output Ports
 	//---------------------------------
 	for (i=0;i<MAX_NUM_ZMOPS;i++) {
-		zmops[i].n_connections=jack_port_connected(zmops[i].jport);
+		int n_connections=jack_port_connected(zmops[i].jport);
+		//First connection => replay the channel state. Further connections => the connected peers
+		//get the replay too, so bank & program are not sent again, neither the program cache reset.
+		if (n_connections>zmops[i].n_connections) {
+			if (zmops[i].n_connections==0) {
+				zmop_reset_program_cache(i);
+				zmop_replay_chan_state(i);
+			} else {
+				zmop_replay_chan_ctrls(i);
+			}
+		}
+		zmops[i].n_connections=n_connections;
 	}
 	//fprintf(stderr, "ZynMidiRouter: Num. of connections refreshed\n");
 
@@ -1477,6 +2448,14 @@ int jack_process(jack_nframes_t nframes, void *arg) {
 	return 0;
 }
 
+int jack_process(jack_nframes_t nframes, void *arg) {
+	//Cycle sequence is odd while running => see midi_filter_publish()
+	__atomic_add_fetch(&jack_cycle_seq, 1, __ATOMIC_SEQ_CST);
+	int res=jack_process_cycle(nframes);
+	__atomic_add_fetch(&jack_cycle_seq, 1, __ATOMIC_RELEASE);
+	return res;
+}
+
 //-----------------------------------------------------
 // MIDI Internal Input <= Internal (zyncoder, etc.)
 //-----------------------------------------------------
@@ -104,6 +104,93 @@ struct mf_noterange_st {
 	int8_t halftone_trans;
 };
 
+//Keyboard zones => split, layer & transpose. Compiled into a per-note target list.
+#define MAX_NUM_ZONES 8
+
+struct mf_zone_st {
+	uint8_t enabled;
+	uint8_t note_low;
+	uint8_t note_high;
+	uint8_t chan_to;
+	int8_t transpose;
+};
+
+struct mf_zone_target_st {
+	uint8_t chan;
+	uint8_t note;
+};
+
+//Compiled zones of all channels. Double buffered => see midi_filter_publish().
+struct mf_zone_map_st {
+	struct mf_zone_target_st targets[16][128][MAX_NUM_ZONES];
+	uint8_t count[16][128];
+	uint8_t enabled[16];
+};
+
+//Event fan-out => extra destinations of a source event, each one with its own value table.
+//Compiled into a contiguous list of destinations per source.
+#define MAX_NUM_FANOUTS 128
+
+struct mf_fanout_st {
+	uint8_t enabled;
+	struct midi_event_st from;
+	struct midi_event_st to;
+	uint8_t val_lut[128];
+};
+
+struct mf_fanout_dest_st {
+	uint8_t status;
+	uint8_t num;
+	uint8_t *val_lut;
+};
+
+//Compiled fan-outs of all sources. Double buffered => see midi_filter_publish().
+struct mf_fanout_map_st {
+	struct mf_fanout_dest_st dests[MAX_NUM_FANOUTS];
+	uint8_t first[8][16][128];
+	uint8_t count[8][16][128];
+};
+
+//CC encodings => absolute & relative (endless encoders). Used as bit masks by the detector.
+#define CC_MODE_AUTO 0
+#define CC_MODE_ABSOLUTE 1
+#define CC_MODE_BINOFFSET 2		// 64 +/- delta
+#define CC_MODE_TWOSCOMP 4		// +delta => delta, -delta => 128-delta
+#define CC_MODE_SIGNMAG 8		// +delta => delta, -delta => 64+delta
+#define CC_MODE_RELATIVE (CC_MODE_BINOFFSET|CC_MODE_TWOSCOMP|CC_MODE_SIGNMAG)
+
+//Max. delta of a relative value & max. step between absolute values in a continuous move
+#define CC_DETECT_MAX_DELTA 24
+#define CC_DETECT_MAX_JUMP 12
+//Consecutive values that only a relative encoding produces => the stream is relative
+#define CC_DETECT_RELATIVE_COUNT 4
+//Events held back while detecting => when full or idle, the stream is absolute
+#define CC_DETECT_MAX_HOLD 8
+#define CC_DETECT_HOLD_TIMEOUT_US 100000
+
+struct mf_cc_detect_st {
+	uint8_t forced;				// encoding set by user => kept when the automode changes
+	uint8_t mode;				// encoding in use, CC_MODE_AUTO => detecting
+	uint8_t modes;				// relative encodings that can produce the held values
+	uint8_t val;				// decoded value => relative steps accumulate on it
+	int16_t last_raw;			// last received value, -1 => none
+	uint8_t n_rel;				// consecutive values that only a relative encoding produces
+	uint8_t n;					// held values
+	uint8_t raw[CC_DETECT_MAX_HOLD];
+	uint8_t iz;					// input port of the held values
+	uint8_t listed;				// in the held list
+	jack_time_t tsus;			// time of the last held value
+};
+
+//Channel state => last values routed to every channel port (ZMOP_CHn), -1 => unknown.
+//Replayed to the port when it gets a new connection.
+struct mf_chan_state_st {
+	int16_t ctrl_val[128];
+	int16_t program;
+	int16_t pressure;
+	int16_t pitchbend;
+};
+
 struct midi_filter_st {
 	int tuning_pitchbend;
 	int master_chan;
@@ -113,18 +200,28 @@ struct midi_filter_st {
 	int cc_automode;
 
 	struct mf_noterange_st noterange[16];
+	struct mf_zone_st zones[16][MAX_NUM_ZONES];
+	struct mf_zone_map_st zone_maps[2];
+	int zone_map_i;			// published copy
 	struct mf_clone_st clone[16][16];
 
 	struct midi_event_st event_map[8][16][128];
+	struct mf_fanout_st fanouts[MAX_NUM_FANOUTS];
+	struct mf_fanout_map_st fanout_maps[2];
+	int fanout_map_i;		// published copy
 	struct midi_event_st cc_swap[16][128];
+	uint8_t cc_val_lut[16][128][128];
 
-	uint8_t ctrl_mode[16][128];
-	uint8_t ctrl_relmode_count[16][128];
+	struct mf_cc_detect_st cc_detect[16][128];
+	uint16_t cc_detect_held[16*128];	// (chan << 7) | cc of the detectors holding values
+	int cc_detect_n_held;
 
 	uint8_t last_ctrl_val[16][128];
 	uint16_t last_pb_val[16];
 
 	uint8_t note_state[16][128];
+
+	struct mf_chan_state_st chan_state[16];
 };
 struct midi_filter_st midi_filter;
 
@@ -166,6 +263,12 @@ int8_t get_midi_filter_octave_trans(uint8_t chan);
 int8_t get_midi_filter_halftone_trans(uint8_t chan);
 void reset_midi_filter_note_range(uint8_t chan);
 
+//MIDI Keyboard Zones => when a channel has zones, they replace its note-range, transpose & note clones
+int set_midi_filter_zone(uint8_t chan, uint8_t iz, uint8_t note_low, uint8_t note_high, uint8_t chan_to, int8_t transpose);
+int del_midi_filter_zone(uint8_t chan, uint8_t iz);
+struct mf_zone_st *get_midi_filter_zone(uint8_t chan, uint8_t iz);
+void reset_midi_filter_zones(uint8_t chan);
+
 //MIDI Filter Core functions
 void set_midi_filter_event_map_st(struct midi_event_st *ev_from, struct midi_event_st *ev_to);
 void set_midi_filter_event_map(enum midi_event_type_enum type_from, uint8_t chan_from, uint8_t num_from, enum midi_event_type_enum type_to, uint8_t chan_to, uint8_t num_to);
@@ -177,6 +280,17 @@ void del_midi_filter_event_map_st(struct midi_event_st *ev_filter);
 void del_midi_filter_event_map(enum midi_event_type_enum type_from, uint8_t chan_from, uint8_t num_from);
 void reset_midi_filter_event_map();
 
+//MIDI Filter Event Fan-out => emitted with the source event, after the ignore check & relative decoding, before its mapping.
+//Only channel events. The value table is identity by default. Returns the fan-out index or -1.
+int add_midi_filter_event_fanout(enum midi_event_type_enum type_from, uint8_t chan_from, uint8_t num_from, enum midi_event_type_enum type_to, uint8_t chan_to, uint8_t num_to);
+int set_midi_filter_event_fanout_lut(int i, uint8_t lut[128]);
+uint8_t *get_midi_filter_event_fanout_lut(int i);
+struct mf_fanout_st *get_midi_filter_event_fanout(int i);
+int del_midi_filter_event_fanout(int i);
+void del_midi_filter_event_fanouts(enum midi_event_type_enum type_from, uint8_t chan_from, uint8_t num_from);
+void reset_midi_filter_event_fanouts();
+void compile_midi_filter_event_fanouts();
+
 //MIDI Filter Mapping
 void set_midi_filter_cc_map(uint8_t chan_from, uint8_t cc_from, uint8_t chan_to, uint8_t cc_to);
 void set_midi_filter_cc_ignore(uint8_t chan, uint8_t cc_from);
@@ -184,8 +298,32 @@ uint8_t get_midi_filter_cc_map(uint8_t chan, uint8_t cc_from);
 void del_midi_filter_cc_map(uint8_t chan, uint8_t cc_from);
 void reset_midi_filter_cc_map();
 
-// MIDI Controller Auto-Mode (Absolut <=> Relative)
+//MIDI Filter CC value transform => applied to the decoded source CC value in the event map lookup
+void set_midi_filter_cc_lut(uint8_t chan, uint8_t cc, uint8_t lut[128]);
+//Range & response curve => val_min>val_max is inverted, curve=1.0 is linear
+void set_midi_filter_cc_curve(uint8_t chan, uint8_t cc, uint8_t val_min, uint8_t val_max, float curve);
+uint8_t *get_midi_filter_cc_lut(uint8_t chan, uint8_t cc);
+void reset_midi_filter_cc_lut(uint8_t chan, uint8_t cc);
+void reset_midi_filter_cc_luts();
+
+//MIDI Channel State cache => chan=-1 resets all channels
+void update_midi_filter_chan_state(int izmip, uint8_t *data, int size);
+int get_midi_filter_chan_program(uint8_t chan);
+int get_midi_filter_chan_ctrl(uint8_t chan, uint8_t cc);
+void reset_midi_filter_chan_state(int chan);
+
+// MIDI Controller Auto-Mode (Absolut <=> Relative) => the encoding of continuous controllers is detected
 void set_midi_filter_cc_automode(int mfccam);
+//Encoding of a controller => overrides the automode
+void set_midi_filter_cc_mode(uint8_t chan, uint8_t cc, uint8_t mode);
+int get_midi_filter_cc_mode(uint8_t chan, uint8_t cc);
+//Forget the encodings set by user
+void reset_midi_filter_cc_modes();
+//Decode a received value => absolute controller value, -1 if held back while detecting
+int decode_midi_filter_cc(uint8_t chan, uint8_t cc, uint8_t val);
+//Held values => resolved as absolute when idle for CC_DETECT_HOLD_TIMEOUT_US
+void hold_midi_filter_cc(int iz, uint8_t chan, uint8_t cc);
+int get_midi_filter_cc_timeout(int iz);
 
 // MIDI System Events enable/disable
 void set_midi_filter_system_events(int mfse);
@@ -210,6 +348,8 @@ void reset_midi_filter_cc_swap();
 
 #define FLAG_ZMOP_DROPPC 1
 #define FLAG_ZMOP_TUNING 2
+#define FLAG_ZMOP_COALESCE 4
+#define FLAG_ZMOP_DEDUPPC 8
 
 #define FLAG_ZMIP_UI 1
 #define FLAG_ZMIP_ZYNCODER 2
@@ -304,6 +444,10 @@ struct zmop_st {
 	int event_counter[MAX_NUM_ZMIPS];
 	uint32_t flags;
 	int n_connections;
+	int replay_step;
+	int16_t bank[16];			// last bank select written (MSB << 7 | LSB), -1 => unknown
+	int16_t pc_bank[16];		// bank of the last program change written
+	int16_t program[16];		// last program change written, -1 => unknown
 };
 struct zmop_st zmops[MAX_NUM_ZMOPS];
 
@@ -312,22 +456,81 @@ int zmop_set_flags(int iz, uint32_t flags);
 int zmop_has_flags(int iz, uint32_t flag);
 int zmop_chan_set_flag_droppc(int iz, uint8_t flag);
 int zmop_chan_get_flag_droppc(int ch);
+//Drop program changes that repeat the last bank & program written to the port (except from UI)
+int zmop_chan_set_flag_deduppc(int ch, uint8_t flag);
+int zmop_chan_get_flag_deduppc(int ch);
+void zmop_reset_program_cache(int iz);
+void zmop_update_program_cache(int iz, const jack_midi_data_t *data);
 int zmop_set_route_from(int izmop, int izmip, int route);
 int zmop_reset_event_counters(int iz);
 jack_midi_event_t *zmop_pop_event(int izmop, int *izmip);
 
+//CC coalescing => only the last value of every continuous controller (CC, pitch-bend,
+//channel pressure) is written in a cycle. Any other event of the channel (notes,
+//program change, switch/RPN/NRPN/mode CCs) keeps the values sent before it.
+int zmop_set_flag_coalesce(int iz, uint8_t flag);
+int zmop_get_flag_coalesce(int iz);
+int zmop_coalesce_events(int izmop);
+jack_midi_event_t *zmop_next_event(int izmop, int *izmip);
+
+//Channel state replay => bank, program, controllers, pitch-bend & pressure are written
+//to a channel port when it gets a new connection, at most ZMOP_REPLAY_MAX_EVENTS per cycle.
+//Data entry, RPN/NRPN & channel mode controllers are not replayed. -1 => idle.
+//The events go to all the connected peers, so a further connection only replays the controllers,
+//pitch-bend & pressure, that are safe to send again.
+#define ZMOP_REPLAY_MAX_EVENTS 32
+#define ZMOP_REPLAY_STEP_CC 3
+#define ZMOP_REPLAY_STEP_PB 131
+#define ZMOP_REPLAY_STEP_CP 132
+#define ZMOP_REPLAY_STEP_END 133
+int zmop_replay_chan_state(int iz);
+int zmop_replay_chan_ctrls(int iz);
+int zmop_write_chan_state(int iz, void *output_port_buffer);
+
+
+//Note ownership => destinations of every note-on, so its note-off follows it
+#define MAX_NOTE_OWNER_DESTS 16
+
+struct zmip_note_dest_st {
+	uint8_t chan;
+	uint8_t note;
+};
+
+struct zmip_note_owner_st {
+	uint8_t n;
+	struct zmip_note_dest_st dests[MAX_NOTE_OWNER_DESTS];
+};
 
 struct zmip_st {
 	jack_port_t *jport;
 	uint32_t flags;
 	jack_midi_event_t events[JACK_MIDI_BUFFER_SIZE];
 	int n_events;
+	uint8_t velocity_curve[16][128];
+	struct zmip_note_owner_st note_owners[16][128];
 };
 struct zmip_st zmips[MAX_NUM_ZMIPS];
 
 int zmip_init(int iz, char *name, uint32_t flags);
 int zmip_set_flags(int iz, uint32_t flags);
 int zmip_has_flags(int iz, uint32_t flag);
+
+//Velocity curves => applied to NOTE_ON in the note-range stage (FLAG_ZMIP_NOTERANGE).
+//chan=-1 => all channels. Param is the velocity for ZMIP_VELOCITY_FIXED.
+#define ZMIP_VELOCITY_LINEAR 0
+#define ZMIP_VELOCITY_LOG 1
+#define ZMIP_VELOCITY_EXP 2
+#define ZMIP_VELOCITY_FIXED 3
+int zmip_set_velocity_curve(int iz, int chan, int curve, uint8_t param);
+int zmip_set_velocity_lut(int iz, int chan, uint8_t lut[128]);
+uint8_t *zmip_get_velocity_lut(int iz, int chan);
+
+//Note ownership table => indexed by the incoming (chan, note)
+void zmip_add_note_owner(int iz, uint8_t chan, uint8_t note, uint8_t chan_to, uint8_t note_to);
+void zmip_reset_note_owners(int iz);
+
+//Push a copy of the event for every fan-out destination of the source (type, chan, num)
+void zmip_push_event_fanout(int iz, struct mf_fanout_map_st *fanout_map, jack_midi_event_t *ev, uint8_t type, uint8_t chan, uint8_t num, uint8_t val, int owner_chan, uint8_t owner_note, int skip_notes);
 int zmip_push_data(int iz, jack_midi_event_t *ev);
 int zmip_clear_events(int iz);
 int zmips_clear_events();
@@ -0,0 +1,143 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Switch Glue Library
+ *
+ * Switch handling shared by the GPIO (zyncoder) and I2C HWC
+ * (zyncoder_i2c) builds: debounced status changes, press & release
+ * timing, settle time expiration and the switch events queue.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(I2C_HWC)
+	#include "zyncoder_i2c.h"
+#else
+	#include "zyncoder.h"
+#endif
+
+//-----------------------------------------------------------------------------
+// Switch events queue
+//-----------------------------------------------------------------------------
+
+// Single producer (switch updates, serialized by zynswitch_lock) & single consumer (UI) => lock-free ring
+struct zynswitch_event_st zynswitch_events[ZYNSWITCH_EVENT_QUEUE_SIZE];
+unsigned int zynswitch_events_head=0;
+unsigned int zynswitch_events_tail=0;
+unsigned int zynswitch_events_lost=0;
+
+void push_zynswitch_event(uint8_t i, uint8_t status, unsigned long int tsus, unsigned int dtus) {
+	unsigned int head=__atomic_load_n(&zynswitch_events_head, __ATOMIC_RELAXED);
+	unsigned int next=(head+1) % ZYNSWITCH_EVENT_QUEUE_SIZE;
+	if (next==__atomic_load_n(&zynswitch_events_tail, __ATOMIC_ACQUIRE)) {
+		zynswitch_events_lost++;
+		return;
+	}
+	struct zynswitch_event_st *ev=zynswitch_events+head;
+	ev->i=i;
+	ev->status=status;
+	ev->tsus=tsus;
+	ev->dtus=dtus;
+	__atomic_store_n(&zynswitch_events_head, next, __ATOMIC_RELEASE);
+}
+
+int get_zynswitch_events(struct zynswitch_event_st *events, int n) {
+	int k=0;
+	unsigned int tail=__atomic_load_n(&zynswitch_events_tail, __ATOMIC_RELAXED);
+	unsigned int head=__atomic_load_n(&zynswitch_events_head, __ATOMIC_ACQUIRE);
+	while (k<n && tail!=head) {
+		events[k++]=zynswitch_events[tail];
+		tail=(tail+1) % ZYNSWITCH_EVENT_QUEUE_SIZE;
+	}
+	__atomic_store_n(&zynswitch_events_tail, tail, __ATOMIC_RELEASE);
+	return k;
+}
+
+unsigned int get_zynswitch_events_lost() {
+	return zynswitch_events_lost;
+}
+
+//-----------------------------------------------------------------------------
+// Switch debounce glue
+//-----------------------------------------------------------------------------
+
+pthread_mutex_t zynswitch_lock=PTHREAD_MUTEX_INITIALIZER;
+
+void process_zynswitch_status(struct zynswitch_st *zynswitch, unsigned long int tsus) {
+	zynswitch->status=zynswitch->debounce.status;
+
+	send_zynswitch_midi(zynswitch, zynswitch->status);
+
+	//printf("SWITCH %d => STATUS=%d (%lu)\n",zynswitch-zynswitches,zynswitch->status,tsus);
+	if (zynswitch->status==1) {
+		if (zynswitch->tsus>0) {
+			zynswitch->dtus=tsus-zynswitch->tsus;
+			zynswitch->tsus=0;
+		}
+		//Initial status isn't queued as a release
+		if (zynswitch->press_tsus>0) {
+			push_zynswitch_event(zynswitch-zynswitches, 1, tsus, tsus-zynswitch->press_tsus);
+			zynswitch->press_tsus=0;
+		}
+	} else {
+		zynswitch->tsus=tsus;
+		zynswitch->press_tsus=tsus;
+		push_zynswitch_event(zynswitch-zynswitches, 0, tsus, 0);
+	}
+}
+
+void update_zynswitch_state(uint8_t i, uint8_t status, unsigned long int tsus) {
+	if (i>=MAX_NUM_ZYNSWITCHES) return;
+	struct zynswitch_st *zynswitch = zynswitches + i;
+	if (zynswitch->enabled==0) return;
+
+	pthread_mutex_lock(&zynswitch_lock);
+	if (zyndebounce_update(&zynswitch->debounce, status, tsus)) process_zynswitch_status(zynswitch, tsus);
+	pthread_mutex_unlock(&zynswitch_lock);
+}
+
+void zynswitches_debounce_expire(unsigned long int tsus) {
+	int i;
+	pthread_mutex_lock(&zynswitch_lock);
+	for (i=0;i<MAX_NUM_ZYNSWITCHES;i++) {
+		struct zynswitch_st *zynswitch = zynswitches + i;
+		if (zynswitch->enabled==0) continue;
+		if (zyndebounce_expire(&zynswitch->debounce, tsus)) process_zynswitch_status(zynswitch, tsus);
+	}
+	pthread_mutex_unlock(&zynswitch_lock);
+}
+
+int setup_zynswitch_debounce(uint8_t i, unsigned int press_us, unsigned int release_us) {
+	if (i >= MAX_NUM_ZYNSWITCHES) {
+		printf("Zyncoder: Maximum number of zynswitches exceeded: %d\n", MAX_NUM_ZYNSWITCHES);
+		return 0;
+	}
+	struct zynswitch_st *zynswitch = zynswitches + i;
+	pthread_mutex_lock(&zynswitch_lock);
+	zynswitch->debounce.press_us = press_us;
+	zynswitch->debounce.release_us = release_us;
+	pthread_mutex_unlock(&zynswitch_lock);
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
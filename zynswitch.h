@@ -0,0 +1,74 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Switch Glue Library
+ *
+ * Switch handling shared by the GPIO (zyncoder) and I2C HWC
+ * (zyncoder_i2c) builds: debounced status changes, press & release
+ * timing, settle time expiration and the switch events queue.
+ *
+ * Copyright (C) 2015-2021 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "zyndebounce.h"
+
+//-----------------------------------------------------------------------------
+// Switch events queue
+//-----------------------------------------------------------------------------
+
+// Press (status 0) & release (status 1) records from all the switches, in order
+#define ZYNSWITCH_EVENT_QUEUE_SIZE 64
+
+struct zynswitch_event_st {
+	uint8_t i;				// switch index
+	uint8_t status;			// 0 => pressed, 1 => released
+	unsigned long tsus;		// time of the change (CLOCK_MONOTONIC)
+	unsigned int dtus;		// press duration (release only)
+};
+
+// read up to n queued events, oldest first. Returns the number of events read.
+int get_zynswitch_events(struct zynswitch_event_st *events, int n);
+// number of events dropped because the queue was full
+unsigned int get_zynswitch_events_lost();
+// queue an event => called by the switch updates, serialized by zynswitch_lock
+void push_zynswitch_event(uint8_t i, uint8_t status, unsigned long int tsus, unsigned int dtus);
+
+//-----------------------------------------------------------------------------
+// Switch debounce glue
+//-----------------------------------------------------------------------------
+
+// struct zynswitch_st & zynswitches are defined by the build (zyncoder.h or zyncoder_i2c.h)
+struct zynswitch_st;
+
+//Serialize the switch updates from ISRs, polling and the debounce timer
+pthread_mutex_t zynswitch_lock;
+
+//Send the MIDI event assigned to a switch => implemented by the build
+void send_zynswitch_midi(struct zynswitch_st *zynswitch, uint8_t status);
+
+//Process a debounced switch status change, with the time of the change
+void process_zynswitch_status(struct zynswitch_st *zynswitch, unsigned long int tsus);
+//Update switch raw status, with the time of the change. Does nothing if switch disabled.
+void update_zynswitch_state(uint8_t i, uint8_t status, unsigned long int tsus);
+//Debounce timer callback => switches that changed while settling
+void zynswitches_debounce_expire(unsigned long int tsus);
+
+//-----------------------------------------------------------------------------
@@ -30,10 +30,17 @@
 #include <math.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <time.h>
 
-#include <wiringPi.h>
-#include <wiringPiI2C.h>
-#include <tof.h> // time of flight sensor library
+#if defined(HAVE_WIRINGPI_LIB)
+	#include <wiringPi.h>
+	#include <tof.h> // time of flight sensor library
+#else
+	#include "wiringPiEmu.h"
+	#include "zyni2cemu.h"
+#endif
 
 #include "zyncoder.h"
 
@@ -41,23 +48,25 @@
 // TCA954X (43/44/48) Stuff => I2C Multiplexer
 //-----------------------------------------------------------------------------
 
-int i2cmult_fd = 0;
+int i2cmult_ok = 0;
+int i2cmult_chan = -1;
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
 int init_i2c_multiplexer() {
-	i2cmult_fd=wiringPiI2CSetup(TCA954X_I2C_ADDRESS);
-	if (i2cmult_fd>0) {
-		wiringPiI2CReadReg8(i2cmult_fd, 0x0);
+	if (zyni2c_read_reg8(ZYNI2C_PRIO_SENSOR, TCA954X_I2C_ADDRESS, 0x0)>=0) {
+		i2cmult_ok=1;
+		i2cmult_chan=-1;
 		return 1;
 	}
 	return 0;
 }
 
+//The channel switch is done when the write transaction ends, so no wait is needed.
+//The selected channel is cached to avoid redundant bus transactions.
 void select_zyntof_chan(uint8_t i) {
-	if (i2cmult_fd>0) {
-		wiringPiI2CWriteReg8(i2cmult_fd, 0x0, 0xF&(0x1<<i));
-		//wiringPiI2CWriteReg8(i2cmult_fd, 0x0, 0x1);
-		usleep(10);
+	if (i2cmult_ok && i2cmult_chan!=i) {
+		zyni2c_write_reg8(ZYNI2C_PRIO_SENSOR, TCA954X_I2C_ADDRESS, 0x0, 0xF&(0x1<<i));
+		i2cmult_chan=i;
 	}
 }
 
@@ -65,28 +74,81 @@ void select_zyntof_chan(uint8_t i) {
 // VL53L0X Stuff
 //-----------------------------------------------------------------------------
 
+#define write_vl53l0x_reg(reg, val) zyni2c_write_reg8(ZYNI2C_PRIO_SENSOR, VL53L0X_I2C_ADDRESS, reg, val)
+#define read_vl53l0x_reg(reg) zyni2c_read_reg8(ZYNI2C_PRIO_SENSOR, VL53L0X_I2C_ADDRESS, reg)
+
+//The tof library uses its own fd => its calls are run on the I2C bus thread
+int _init_vl53l0x(void *arg) {
+	return tofInit(1, VL53L0X_I2C_ADDRESS, VL53L0X_DISTANCE_MODE);
+}
+
+int _get_vl53l0x_model(void *arg) {
+	int *model_rev=arg;
+	return tofGetModel(model_rev, model_rev+1);
+}
+
+//Start back-to-back ranging on the selected sensor. The sensor must be initialized (tofInit)
+int start_vl53l0x_continuous() {
+	write_vl53l0x_reg(0x80, 0x01);
+	write_vl53l0x_reg(0xFF, 0x01);
+	write_vl53l0x_reg(0x00, 0x00);
+	int stop_variable=read_vl53l0x_reg(0x91);
+	if (stop_variable<0) return 0;
+	write_vl53l0x_reg(0x91, stop_variable);
+	write_vl53l0x_reg(0x00, 0x01);
+	write_vl53l0x_reg(0xFF, 0x00);
+	write_vl53l0x_reg(0x80, 0x00);
+	//GPIO1 => new sample ready, active low
+	write_vl53l0x_reg(VL53L0X_REG_SYSTEM_INTERRUPT_CONFIG_GPIO, VL53L0X_INTERRUPT_NEW_SAMPLE_READY);
+	int hv_mux=read_vl53l0x_reg(VL53L0X_REG_GPIO_HV_MUX_ACTIVE_HIGH);
+	write_vl53l0x_reg(VL53L0X_REG_GPIO_HV_MUX_ACTIVE_HIGH, hv_mux & ~0x10);
+	write_vl53l0x_reg(VL53L0X_REG_SYSTEM_INTERRUPT_CLEAR, 0x01);
+	write_vl53l0x_reg(VL53L0X_REG_SYSRANGE_START, VL53L0X_SYSRANGE_BACK_TO_BACK);
+	return 1;
+}
+
+//Read a new sample from the selected sensor, if available. Returns -1 if no new sample
+int read_vl53l0x_sample() {
+	int status=read_vl53l0x_reg(VL53L0X_REG_RESULT_INTERRUPT_STATUS);
+	if (status<0 || (status & 0x07)==0) return -1;
+	int val=zyni2c_read_reg16(ZYNI2C_PRIO_SENSOR, VL53L0X_I2C_ADDRESS, VL53L0X_REG_RESULT_RANGE_MM);
+	write_vl53l0x_reg(VL53L0X_REG_SYSTEM_INTERRUPT_CLEAR, 0x01);
+	return val;
+}
+
 //-----------------------------------------------------------------------------
 // Generate MIDI CC from Distance
 //-----------------------------------------------------------------------------
 
+unsigned long zyntof_get_tsus() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
 void setup_zyntof(uint8_t i, uint8_t midi_evt, uint8_t midi_chan, uint8_t midi_num) {
 	zyntofs[i].i = i;
 	zyntofs[i].midi_evt = midi_evt;
 	zyntofs[i].midi_chan = midi_chan;
 	zyntofs[i].midi_num = midi_num;
 
+	setup_zynccmap(ZYNCCMAP_TOF0 + i, midi_evt, midi_chan, midi_num);
+	set_zynccmap_range(ZYNCCMAP_TOF0 + i, MIN_TOF_DISTANCE, MAX_TOF_DISTANCE);
+
 	if (zyntofs[i].enabled==0) {
 		zyntofs[i].val = 0;
-		zyntofs[i].midi_val = 0;
 		pthread_mutex_lock(&mutex);
 		select_zyntof_chan(i);
-		if (tofInit(1, VL53L0X_I2C_ADDRESS, VL53L0X_DISTANCE_MODE)!=1) {
+		if (zyni2c_call(ZYNI2C_PRIO_SENSOR, _init_vl53l0x, NULL)!=1) {
 			printf("ZynTOF: Can't setup zyntof device VL53L0X-%d.\n", i);
+		} else if (!start_vl53l0x_continuous()) {
+			printf("ZynTOF: Can't start continuous ranging on device VL53L0X-%d.\n", i);
 		} else {
+			zyntofs[i].next_tsus = zyntof_get_tsus() + ZYNTOF_SAMPLE_US;
 			zyntofs[i].enabled = 1;
-			int model, rev;
-			tofGetModel(&model, &rev);
-			printf("ZynTOF: Device VL53L0X-%d successfully opened (model %d, rev %d)\n", i, model, rev);
+			int model_rev[2];
+			zyni2c_call(ZYNI2C_PRIO_SENSOR, _get_vl53l0x_model, model_rev);
+			printf("ZynTOF: Device VL53L0X-%d successfully opened (model %d, rev %d)\n", i, model_rev[0], model_rev[1]);
 		}
 		pthread_mutex_unlock(&mutex);
 	}
@@ -94,61 +156,91 @@ void setup_zyntof(uint8_t i, uint8_t midi_evt, uint8_t midi_chan, uint8_t midi_n
 
 void disable_zyntof(uint8_t i) {
 	zyntofs[i].enabled = 0;
+	disable_zynccmap(ZYNCCMAP_TOF0 + i);
 }
 
+//Range, curve, deadband, smoothing & rate limit are managed by the CC map
 void send_zyntof_midi(uint8_t i) {
-	uint32_t v;
-	if (zyntofs[i].val<MIN_TOF_DISTANCE) {
-		v = 0;
-	} else if (zyntofs[i].val>MAX_TOF_DISTANCE) {
-		v = 16384;
-		return;
-	} else {
-		v = 16384 * (zyntofs[i].val - MIN_TOF_DISTANCE) / (MAX_TOF_DISTANCE - MIN_TOF_DISTANCE);
-	}
-	if (zyntofs[i].midi_evt==PITCH_BENDING) {
-		//Send MIDI event to engines and ouput (ZMOPS)
-		internal_send_pitchbend_change(zyntofs[i].midi_chan, v);
-		//printf("ZYNTOF [%d] => MIDI %d\n", i, v);
-	} else {
-		uint8_t mv = v>>7;
-		if (mv!=zyntofs[i].midi_val) {
-			//printf("ZYNTOF [%d] => MIDI %d\n", i, mv);
-			zyntofs[i].midi_val = mv;
-			if (zyntofs[i].midi_evt==CTRL_CHANGE) {
-				//Send MIDI event to engines and ouput (ZMOPS)
-				internal_send_ccontrol_change(zyntofs[i].midi_chan, zyntofs[i].midi_num, mv);
-				//Update zyncoders
-				midi_event_zyncoders(zyntofs[i].midi_chan, zyntofs[i].midi_num, mv);
-				//Send MIDI event to UI
-				write_zynmidi_ccontrol_change(zyntofs[i].midi_chan, zyntofs[i].midi_num, mv);
-			} else if (zyntofs[i].midi_evt==CHAN_PRESS) {
-				//Send MIDI event to engines and ouput (ZMOPS)
-				internal_send_chan_press(zyntofs[i].midi_chan, mv);
-			} 
-		}
-	}
+	//Out of range => Keep last value
+	if (zyntofs[i].val>MAX_TOF_DISTANCE) return;
+	zynccmap_input(ZYNCCMAP_TOF0 + i, zyntofs[i].val);
+}
+
+//Sensors are read only when a new sample is expected (or signaled by the data-ready line).
+//When more sensors are due, the currently selected multiplexer channel goes first.
+sem_t zyntof_drdy_sem;
+
+#ifdef ZYNTOF_DRDY_PIN
+//GPIO1 outputs of all sensors are wired (open drain) to the same pin
+void zyntof_drdy_ISR() {
+	sem_post(&zyntof_drdy_sem);
 }
+#endif
 
 void * poll_zyntofs(void *arg) {
-	int i;
+	int i, j, first, val, drdy=0;
+	unsigned long tsus, next_tsus;
+	struct timespec ts;
 	while (1) {
-		for (i=0;i<MAX_NUM_ZYNTOFS;i++) {
-			if (zyntofs[i].enabled) {
-				pthread_mutex_lock(&mutex);
-				select_zyntof_chan(i);
-				zyntofs[i].val = tofReadDistance();
+		tsus=zyntof_get_tsus();
+		pthread_mutex_lock(&mutex);
+		//Start from the selected channel
+		first=i2cmult_chan>=0 ? i2cmult_chan : 0;
+		for (j=0;j<MAX_NUM_ZYNTOFS;j++) {
+			i=(first + j) % MAX_NUM_ZYNTOFS;
+			if (!zyntofs[i].enabled) continue;
+			if (!drdy && (long)(zyntofs[i].next_tsus-tsus)>0) continue;
+			select_zyntof_chan(i);
+			val=read_vl53l0x_sample();
+			if (val>=0) {
+				zyntofs[i].val = val;
+				zyntofs[i].next_tsus = tsus + ZYNTOF_SAMPLE_US;
 				pthread_mutex_unlock(&mutex);
 				send_zyntof_midi(i);
+				pthread_mutex_lock(&mutex);
 				//printf("ZYNTOF [%d] => %d\n", i, zyntofs[i].val);
+			} else if (!drdy) {
+				zyntofs[i].next_tsus = tsus + ZYNTOF_RETRY_US;
+			}
+		}
+		//Next wake-up => earliest expected sample
+		next_tsus=tsus + ZYNTOF_SAMPLE_US;
+		for (i=0;i<MAX_NUM_ZYNTOFS;i++) {
+			if (zyntofs[i].enabled && (long)(zyntofs[i].next_tsus-next_tsus)<0) next_tsus=zyntofs[i].next_tsus;
+		}
+		pthread_mutex_unlock(&mutex);
+
+#ifdef ZYNTOF_DRDY_PIN
+		next_tsus=tsus + ZYNTOF_DRDY_TIMEOUT_US;
+#endif
+		clock_gettime(CLOCK_REALTIME, &ts);
+		tsus=zyntof_get_tsus();
+		if ((long)(next_tsus-tsus)>0) {
+			ts.tv_nsec+=(next_tsus-tsus)*1000;
+			ts.tv_sec+=ts.tv_nsec/1000000000;
+			ts.tv_nsec%=1000000000;
+			drdy=1;
+			while (sem_timedwait(&zyntof_drdy_sem, &ts)!=0) {
+				if (errno!=EINTR) {
+					drdy=0;
+					break;
+				}
 			}
+		} else {
+			drdy=0;
 		}
-		usleep(POLL_ZYNTOFS_US);
 	}
 	return NULL;
 }
 
 pthread_t init_poll_zyntofs() {
+	sem_init(&zyntof_drdy_sem, 0, 0);
+#ifdef ZYNTOF_DRDY_PIN
+	pinMode(ZYNTOF_DRDY_PIN, INPUT);
+	pullUpDnControl(ZYNTOF_DRDY_PIN, PUD_UP);
+	wiringPiISR(ZYNTOF_DRDY_PIN, INT_EDGE_FALLING, zyntof_drdy_ISR);
+	printf("ZynTOF: Using data-ready interrupt on pin %d\n", ZYNTOF_DRDY_PIN);
+#endif
 	pthread_t tid;
 	int err=pthread_create(&tid, NULL, &poll_zyntofs, NULL);
 	if (err != 0) {
@@ -39,12 +39,29 @@ void select_zyntof_chan(uint8_t i);
 #define VL53L0X_I2C_ADDRESS 0x29
 #define VL53L0X_DISTANCE_MODE 1
 
+//VL53L0X registers used for continuous ranging
+#define VL53L0X_REG_SYSRANGE_START 0x00
+#define VL53L0X_REG_SYSTEM_INTERRUPT_CONFIG_GPIO 0x0A
+#define VL53L0X_REG_SYSTEM_INTERRUPT_CLEAR 0x0B
+#define VL53L0X_REG_RESULT_INTERRUPT_STATUS 0x13
+#define VL53L0X_REG_RESULT_RANGE_MM 0x1E
+#define VL53L0X_REG_GPIO_HV_MUX_ACTIVE_HIGH 0x84
+
+#define VL53L0X_SYSRANGE_BACK_TO_BACK 0x02
+#define VL53L0X_INTERRUPT_NEW_SAMPLE_READY 0x04
+
 //-----------------------------------------------------------------------------
 // Generate MIDI events from Distance
 //-----------------------------------------------------------------------------
 
 #define MAX_NUM_ZYNTOFS 4
-#define POLL_ZYNTOFS_US 1000
+
+//Sensors run in back-to-back continuous mode => a new sample every ~33ms (default timing budget)
+#define ZYNTOF_SAMPLE_US 33000
+//Data not ready when expected => poll again after this time
+#define ZYNTOF_RETRY_US 1000
+//Fallback wait when using data-ready line (ZYNTOF_DRDY_PIN)
+#define ZYNTOF_DRDY_TIMEOUT_US 100000
 
 #define MIN_TOF_DISTANCE 60
 #define MAX_TOF_DISTANCE 600
@@ -57,7 +74,8 @@ struct zyntof_st {
 	uint8_t midi_evt;
 	uint8_t midi_chan;
 	uint8_t midi_num;
-	uint8_t midi_val;
+
+	unsigned long next_tsus;	// time of next expected sample
 };
 struct zyntof_st zyntofs[MAX_NUM_ZYNTOFS];
 